@@ -4,9 +4,12 @@
 #include <sys/socket.h>
 #include <errno.h>
 #include <unistd.h>
+#include <strings.h>
 
 #include "Logger.h"
 #include "InetAddress.h"
+#include "EventLoop.h"
+#include "IoUringPoller.h"
 
 static int createNonblocking()
 {
@@ -23,17 +26,35 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusepor
     , acceptSocket_(createNonblocking())
     , acceptChannel_(loop, acceptSocket_.fd())
     , listenning_(false)
+    , multishotAccept_(false)
 {
     acceptSocket_.setReuseAddr(true);
-    acceptSocket_.setReusePort(true);
+    acceptSocket_.setReusePort(reuseport);
     acceptSocket_.bindAddress(listenAddr);      // bind
     // TcpServer::start()  Acceptor.listen 有新用户的连,接 要执行一个回调(connfd->channel->subloop)
     // baseLoop -> acceptChannel_(listenfd)=>
     acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
 }
 
+Acceptor::Acceptor(EventLoop *loop, int listenfd)
+    : loop_(loop)
+    , acceptSocket_(listenfd)
+    , acceptChannel_(loop, acceptSocket_.fd())
+    , listenning_(false)
+    , multishotAccept_(false)
+{
+    acceptChannel_.setReadCallback(std::bind(&Acceptor::handleRead, this));
+}
+
 Acceptor::~Acceptor()
 {
+    if (acceptOp_)
+    {
+        // 取消multishot accept, 之后到达的连接直接关闭
+        acceptOp_->handler = [](int res, unsigned, Timestamp) { if (res >= 0) ::close(res); };
+        loop_->ioUringPoller()->cancelOp(acceptOp_.get());
+        return;
+    }
     // 把从Poller中感兴趣的事件删除
     acceptChannel_.disableAll();
     // 调用EventLoop->removeChannel  ->  Poller->removeChannel 把Poller的ChannelMap对应的部分删除
@@ -45,7 +66,18 @@ void Acceptor::listen()
 {
     listenning_ = true;
     acceptSocket_.listen();             // listen 
-    acceptChannel_.enableReading();     // acceptChannel_ => Poller acceptChannel_注册至Poller
+    IoUringPoller *uring = loop_->ioUringPoller();
+    if (multishotAccept_ && uring != nullptr && uring->completionSupported())
+    {
+        acceptOp_ = std::make_shared<IoUringOp>();
+        acceptOp_->handler = std::bind(&Acceptor::handleAcceptComplete, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+        startAccept();
+    }
+    else
+    {
+        acceptChannel_.enableReading(); // acceptChannel_ => Poller acceptChannel_注册至Poller
+    }
 
 }
 
@@ -56,16 +88,9 @@ void Acceptor::handleRead()
     int connfd = acceptSocket_.accept(&peerAddr);
     if (connfd >= 0)
     {
-        if (NewConnectionCallback_)
-        {
-            NewConnectionCallback_(connfd, peerAddr);       // 轮询找到subLoop, 唤醒, 分发当前的新客户端的Channel
-        }
-        else
-        {
-            ::close(connfd);
-        }
+        newConnection(connfd, peerAddr);
     }
-    else
+    else if (errno != EAGAIN)       // 多个loop共享监听socket时, 连接可能已经被别的loop取走了
     {
         LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
         if (errno == EMFILE)
@@ -73,4 +98,52 @@ void Acceptor::handleRead()
             LOG_ERROR("%s:%s:%d sockfd reached limit err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
         }
     }
-}
\ No newline at end of file
+}
+
+void Acceptor::newConnection(int connfd, const InetAddress &peerAddr)
+{
+    if (NewConnectionCallback_)
+    {
+        NewConnectionCallback_(connfd, peerAddr);       // 轮询找到subLoop, 唤醒, 分发当前的新客户端的Channel
+    }
+    else
+    {
+        ::close(connfd);
+    }
+}
+
+void Acceptor::startAccept()
+{
+    // multishot accept的所有连接共用一个地址缓冲区不安全, 对端地址用getpeername获取
+    io_uring_sqe *sqe = loop_->ioUringPoller()->prepareOp(acceptOp_.get(), acceptOp_);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = acceptSocket_.fd();
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+}
+
+void Acceptor::handleAcceptComplete(int res, unsigned flags, Timestamp /*receiveTime*/)
+{
+    if (res >= 0)
+    {
+        sockaddr_in addr;
+        socklen_t len = sizeof addr;
+        bzero(&addr, sizeof addr);
+        ::getpeername(res, (sockaddr*)&addr, &len);
+        newConnection(res, InetAddress(addr));
+    }
+    else if (res != -ECANCELED)
+    {
+        LOG_ERROR("%s:%s:%d accept err:%d \n", __FILE__, __FUNCTION__, __LINE__, -res);
+        if (res == -EMFILE)
+        {
+            LOG_ERROR("%s:%s:%d sockfd reached limit err:%d \n", __FILE__, __FUNCTION__, __LINE__, -res);
+        }
+    }
+
+    // multishot被内核终止了, 重新提交
+    if (!(flags & IORING_CQE_F_MORE) && res != -ECANCELED)
+    {
+        startAccept();
+    }
+}
@@ -2,20 +2,25 @@
 #define _ACCEPTOR_H_
 
 #include <functional>
+#include <memory>
 
 #include "noncopyable.h"
 #include "Socket.h"
 #include "Channel.h"
+#include "Timestamp.h"
 
 
 class EventLoop;
 class InetAddress;
+struct IoUringOp;
 
 class Acceptor
 {
 public:
     using NewConnectionCallback = std::function<void(int sockfd, const InetAddress&)>;
     Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reuseport);
+    // 使用已经bind的socket(比如另一个Acceptor的fd的dup), 接管listenfd的所有权
+    Acceptor(EventLoop *loop, int listenfd);
     ~Acceptor();
 
     // 设置新连接的回调函数
@@ -26,17 +31,32 @@ public:
 
     // 判断是否在监听
     bool listenning() const { return listenning_; }
+    // loop使用io_uring时用multishot accept代替等待可读事件, 必须在listen之前调用
+    void setMultishotAccept(bool on) { multishotAccept_ = on; }
+    /*
+     * 用EPOLLEXCLUSIVE注册监听socket, 必须在listen之前调用
+     * 多个loop共享同一个监听socket时, 新连接到达只唤醒其中一个loop, 避免惊群
+    */
+    void setExclusive(bool on) { acceptChannel_.setExclusive(on); }
+    int fd() const { return acceptSocket_.fd(); }
     // 监听本地端口
     void listen();
 private:
     // 处理新用户的连接事件
     void handleRead();
+    // multishot accept
+    void startAccept();
+    void handleAcceptComplete(int res, unsigned flags, Timestamp receiveTime);
+    void newConnection(int connfd, const InetAddress &peerAddr);
     
-    EventLoop *loop_;                                   // Acceptor用的就是用户定义的那个baseLoop, 也称作mainLoop
+    EventLoop *loop_;                                   // 默认是用户定义的那个baseLoop, 也称作mainLoop; 每个subloop各自接收连接时是subloop
     Socket acceptSocket_;                               // 专门用于接收新连接的socket
     Channel acceptChannel_;                             // 专门用于监听新连接的channel
     NewConnectionCallback NewConnectionCallback_;       // 新连接的回调函数
     bool listenning_;
+    bool multishotAccept_;
+    // op在途期间由自己的guard保活, Acceptor析构后迟到的完成事件仍然可以安全处理
+    std::shared_ptr<IoUringOp> acceptOp_;
 };
 
 #endif
\ No newline at end of file
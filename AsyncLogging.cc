@@ -0,0 +1,157 @@
+#include "AsyncLogging.h"
+
+#include <stdio.h>
+#include <chrono>
+
+#include "LogFile.h"
+#include "Timestamp.h"
+
+AsyncLogging::AsyncLogging(const std::string &basename,
+                        off_t rollSize,
+                        int flushInterval,
+                        int rollInterval)
+    : flushInterval_(flushInterval)
+    , basename_(basename)
+    , rollSize_(rollSize)
+    , rollInterval_(rollInterval)
+    , running_(false)
+    , droppedMessages_(0)
+    , thread_(std::bind(&AsyncLogging::threadFunc, this), "AsyncLogging")
+    , currentBuffer_(new LogBuffer)
+    , nextBuffer_(new LogBuffer)
+{
+    buffers_.reserve(kMaxPendingBuffers);
+}
+
+AsyncLogging::~AsyncLogging()
+{
+    if (running_)
+    {
+        stop();
+    }
+}
+
+void AsyncLogging::start()
+{
+    running_ = true;
+    thread_.start();
+}
+
+void AsyncLogging::stop()
+{
+    // stop可能被LOG_FATAL和析构函数重复调用
+    if (running_.exchange(false))
+    {
+        cond_.notify_one();
+        thread_.join();
+    }
+}
+
+void AsyncLogging::append(const char *logline, size_t len)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (currentBuffer_->avail() > len)
+    {
+        currentBuffer_->append(logline, len);
+        return;
+    }
+
+    // 当前缓冲区写满了, 交给后台线程
+    if (buffers_.size() >= kMaxPendingBuffers)
+    {
+        // 后台线程跟不上, 丢弃这条日志, 不能阻塞前端, 也不能无限制地分配内存
+        ++droppedMessages_;
+        return;
+    }
+
+    buffers_.push_back(std::move(currentBuffer_));
+    if (nextBuffer_)
+    {
+        currentBuffer_ = std::move(nextBuffer_);
+    }
+    else
+    {
+        currentBuffer_.reset(new LogBuffer);    // 很少发生, 后台线程会把多出来的缓冲区释放掉
+    }
+    currentBuffer_->append(logline, len);
+    cond_.notify_one();
+}
+
+void AsyncLogging::threadFunc()
+{
+    LogFile output(basename_, rollSize_, flushInterval_, rollInterval_);
+    BufferPtr newBuffer1(new LogBuffer);
+    BufferPtr newBuffer2(new LogBuffer);
+    BufferVector buffersToWrite;
+    buffersToWrite.reserve(kMaxPendingBuffers);
+    int64_t reportedDropped = 0;
+
+    while (running_)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (buffers_.empty())
+            {
+                cond_.wait_for(lock, std::chrono::seconds(flushInterval_));
+            }
+            // 不管currentBuffer_有没有写满都交换出来, 保证日志最多延迟flushInterval_秒落盘
+            buffers_.push_back(std::move(currentBuffer_));
+            currentBuffer_ = std::move(newBuffer1);
+            buffersToWrite.swap(buffers_);
+            if (!nextBuffer_)
+            {
+                nextBuffer_ = std::move(newBuffer2);
+            }
+        }
+
+        int64_t dropped = droppedMessages_;
+        if (dropped != reportedDropped)
+        {
+            char buf[256];
+            int len = snprintf(buf, sizeof buf, "[ERROR]%s : Dropped %ld log messages, %zu buffers pending\n",
+                Timestamp::now().toString().c_str(),
+                static_cast<long>(dropped - reportedDropped),
+                buffersToWrite.size());
+            output.append(buf, len);
+            reportedDropped = dropped;
+        }
+
+        for (const BufferPtr &buffer : buffersToWrite)
+        {
+            output.append(buffer->data(), buffer->length());
+        }
+
+        // 留两个缓冲区给newBuffer1/newBuffer2复用, 其余的释放
+        if (buffersToWrite.size() > 2)
+        {
+            buffersToWrite.resize(2);
+        }
+        if (!newBuffer1)
+        {
+            newBuffer1 = std::move(buffersToWrite.back());
+            buffersToWrite.pop_back();
+            newBuffer1->reset();
+        }
+        if (!newBuffer2)
+        {
+            newBuffer2 = std::move(buffersToWrite.back());
+            buffersToWrite.pop_back();
+            newBuffer2->reset();
+        }
+        buffersToWrite.clear();
+        output.flush();
+    }
+
+    // 退出前把剩余的日志写完
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        buffers_.push_back(std::move(currentBuffer_));
+        buffersToWrite.swap(buffers_);
+        currentBuffer_.reset(new LogBuffer);
+    }
+    for (const BufferPtr &buffer : buffersToWrite)
+    {
+        output.append(buffer->data(), buffer->length());
+    }
+    output.flush();
+}
@@ -0,0 +1,91 @@
+#ifndef _ASYNCLOGGING_H_
+#define _ASYNCLOGGING_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <string.h>
+
+#include "noncopyable.h"
+#include "Thread.h"
+
+/*
+ * 异步日志后端, 双缓冲
+ * 前端线程(各个loop线程)只把日志追加到预先分配好的currentBuffer_中, 临界区内只有一次memcpy, 没有系统调用
+ * 后台线程每flushInterval秒或者有缓冲区写满时, 把写满的缓冲区交换出来, 批量写入LogFile
+ * 过载时(积压的缓冲区过多)直接丢弃日志, 而不是阻塞loop线程或者无限制地分配内存
+ *
+ * 用法:
+ *  AsyncLogging log("server", 500 * 1000 * 1000);
+ *  log.start();
+ *  Logger::setOutput(std::bind(&AsyncLogging::append, &log, _1, _2));
+ *  Logger::setFlush(std::bind(&AsyncLogging::stop, &log));     // LOG_FATAL退出前把日志写完
+*/
+class AsyncLogging : noncopyable
+{
+public:
+    AsyncLogging(const std::string &basename,
+                off_t rollSize,
+                int flushInterval = 3,
+                int rollInterval = 60 * 60 * 24);
+    ~AsyncLogging();
+
+    // 前端接口, 线程安全
+    void append(const char *logline, size_t len);
+
+    void start();
+    void stop();
+
+    // 过载时丢弃的日志条数
+    int64_t droppedMessages() const { return droppedMessages_; }
+private:
+    // 固定大小的日志缓冲区
+    class LogBuffer : noncopyable
+    {
+    public:
+        LogBuffer() : cur_(data_) {}
+
+        size_t length() const { return static_cast<size_t>(cur_ - data_); }
+        size_t avail() const { return static_cast<size_t>(end() - cur_); }
+        const char* data() const { return data_; }
+
+        void append(const char *buf, size_t len)
+        {
+            memcpy(cur_, buf, len);
+            cur_ += len;
+        }
+        void reset() { cur_ = data_; }
+    private:
+        const char* end() const { return data_ + sizeof data_; }
+
+        char data_[4 * 1024 * 1024];
+        char *cur_;
+    };
+
+    using BufferPtr = std::unique_ptr<LogBuffer>;
+    using BufferVector = std::vector<BufferPtr>;
+
+    // 后台线程
+    void threadFunc();
+
+    static const size_t kMaxPendingBuffers = 16;    // 前端积压的缓冲区上限, 超过就丢弃日志
+
+    const int flushInterval_;
+    const std::string basename_;
+    const off_t rollSize_;
+    const int rollInterval_;
+    std::atomic_bool running_;
+    std::atomic<int64_t> droppedMessages_;
+    Thread thread_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    BufferPtr currentBuffer_;       // 前端当前写入的缓冲区
+    BufferPtr nextBuffer_;          // 预备缓冲区
+    BufferVector buffers_;          // 已写满待后台线程写入文件的缓冲区
+};
+
+#endif
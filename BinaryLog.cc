@@ -0,0 +1,238 @@
+#include "BinaryLog.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include "Logger.h"
+#include "Timestamp.h"
+
+namespace
+{
+
+// 每条记录的头部, payload紧随其后, 整条记录按8字节对齐
+struct RecordHeader
+{
+    uint32_t size;                      // 整条记录的长度
+    int32_t level;
+    int64_t microSeconds;
+    BinaryLog::FormatFunc format;       // nullptr表示这是回绕前的填充
+    const char *fmt;
+};
+
+const size_t kRingMask = BinaryLog::kRingSize - 1;
+
+size_t alignRecord(size_t len)
+{
+    return (len + 7) & ~static_cast<size_t>(7);
+}
+
+// 单生产者(日志线程)单消费者(后台格式化线程)的环形缓冲区
+struct Ring
+{
+    Ring()
+        : head(0)
+        , tail(0)
+        , abandoned(false)
+        , pending(0)
+    {}
+
+    char data[BinaryLog::kRingSize];
+    std::atomic<size_t> head;           // 生产者写到的位置, 单调递增
+    std::atomic<size_t> tail;           // 消费者读到的位置, 单调递增
+    std::atomic_bool abandoned;         // 所属线程已经退出, 取空之后可以给新线程复用
+    size_t pending;                     // beginRecord预留出来、等待commitRecord提交的新head
+};
+
+std::mutex g_ringsMutex;
+std::vector<Ring*> g_rings;             // 所有线程的环形缓冲区, 进程退出前不释放
+std::atomic<int64_t> g_dropped(0);
+
+std::mutex g_threadMutex;
+std::thread g_thread;
+std::atomic_bool g_running(false);
+
+// 线程退出时标记其环形缓冲区可以复用
+struct RingHolder
+{
+    Ring *ring = nullptr;
+    ~RingHolder()
+    {
+        if (ring)
+        {
+            ring->abandoned = true;
+        }
+    }
+};
+
+thread_local RingHolder t_ring;
+
+Ring* threadRing()
+{
+    if (t_ring.ring == nullptr)
+    {
+        std::unique_lock<std::mutex> lock(g_ringsMutex);
+        for (Ring *ring : g_rings)
+        {
+            if (ring->abandoned && ring->head == ring->tail)
+            {
+                ring->abandoned = false;
+                t_ring.ring = ring;
+                return ring;
+            }
+        }
+        t_ring.ring = new Ring;
+        g_rings.push_back(t_ring.ring);
+    }
+    return t_ring.ring;
+}
+
+// 处理一个环形缓冲区中已提交的记录, 返回处理的条数
+int drainRing(Ring *ring)
+{
+    int count = 0;
+    size_t tail = ring->tail.load(std::memory_order_relaxed);
+    size_t head = ring->head.load(std::memory_order_acquire);
+    char line[1024];
+
+    while (tail != head)
+    {
+        size_t offset = tail & kRingMask;
+        size_t contiguous = BinaryLog::kRingSize - offset;
+        // 剩余空间连一个头部都放不下, 生产者直接回绕
+        if (contiguous < sizeof(RecordHeader))
+        {
+            tail += contiguous;
+            continue;
+        }
+
+        RecordHeader header;
+        memcpy(&header, ring->data + offset, sizeof header);
+        if (header.format != nullptr)
+        {
+            header.format(header.fmt, ring->data + offset + sizeof header, line, sizeof line);
+            Logger::instance().log(header.level, line, Timestamp(header.microSeconds));
+            ++count;
+        }
+        tail += header.size;
+    }
+
+    ring->tail.store(tail, std::memory_order_release);
+    return count;
+}
+
+int drainAll()
+{
+    std::vector<Ring*> rings;
+    {
+        std::unique_lock<std::mutex> lock(g_ringsMutex);
+        rings = g_rings;
+    }
+
+    int count = 0;
+    for (Ring *ring : rings)
+    {
+        count += drainRing(ring);
+    }
+    return count;
+}
+
+void threadFunc()
+{
+    int idleMs = 1;
+    while (g_running)
+    {
+        if (drainAll() > 0)
+        {
+            idleMs = 1;
+        }
+        else
+        {
+            // 没有日志时逐步退避, 最多每10ms检查一次
+            std::this_thread::sleep_for(std::chrono::milliseconds(idleMs));
+            idleMs = idleMs < 10 ? idleMs * 2 : 10;
+        }
+    }
+    drainAll();
+}
+
+}
+
+char* BinaryLog::beginRecord(int level, const char *fmt, FormatFunc format, size_t payloadLen)
+{
+    size_t need = alignRecord(sizeof(RecordHeader) + payloadLen);
+    if (need > kRingSize / 4)
+    {
+        ++g_dropped;
+        return nullptr;
+    }
+
+    Ring *ring = threadRing();
+    size_t head = ring->head.load(std::memory_order_relaxed);
+    size_t tail = ring->tail.load(std::memory_order_acquire);
+    size_t offset = head & kRingMask;
+    size_t contiguous = kRingSize - offset;
+
+    // 剩余的连续空间不够, 填充到末尾后从头开始写
+    size_t padding = contiguous < need ? contiguous : 0;
+    if (head + padding + need - tail > kRingSize)
+    {
+        ++g_dropped;
+        return nullptr;
+    }
+
+    if (padding > 0)
+    {
+        if (padding >= sizeof(RecordHeader))
+        {
+            RecordHeader pad;
+            memset(&pad, 0, sizeof pad);
+            pad.size = static_cast<uint32_t>(padding);
+            memcpy(ring->data + offset, &pad, sizeof pad);
+        }
+        head += padding;
+        offset = 0;
+    }
+
+    RecordHeader header;
+    header.size = static_cast<uint32_t>(need);
+    header.level = level;
+    header.microSeconds = Timestamp::now().microSecondsSinceEpoch();
+    header.format = format;
+    header.fmt = fmt;
+    memcpy(ring->data + offset, &header, sizeof header);
+
+    ring->pending = head + need;
+    return ring->data + offset + sizeof header;
+}
+
+void BinaryLog::commitRecord()
+{
+    Ring *ring = t_ring.ring;
+    ring->head.store(ring->pending, std::memory_order_release);
+}
+
+void BinaryLog::start()
+{
+    std::unique_lock<std::mutex> lock(g_threadMutex);
+    if (!g_running.exchange(true))
+    {
+        g_thread = std::thread(threadFunc);
+    }
+}
+
+void BinaryLog::stop()
+{
+    std::unique_lock<std::mutex> lock(g_threadMutex);
+    if (g_running.exchange(false))
+    {
+        g_thread.join();
+    }
+}
+
+int64_t BinaryLog::droppedRecords()
+{
+    return g_dropped;
+}
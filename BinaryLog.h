@@ -0,0 +1,167 @@
+#ifndef _BINARYLOG_H_
+#define _BINARYLOG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <tuple>
+#include <type_traits>
+
+/*
+ * 二进制日志模式
+ * 热路径上不调用snprintf, 只把格式串指针、日志级别、时间戳和原始参数拷贝进当前线程的环形缓冲区(单生产者单消费者, 无锁)
+ * 后台线程从各线程的环形缓冲区中取出记录, 用与参数类型对应的格式化函数还原成文本, 再交给Logger的输出函数
+ * 格式串必须是字符串字面量(生命周期为整个进程), 字符串参数会被拷贝, 其余参数必须是可平凡拷贝的类型
+ * 环形缓冲区写满时丢弃日志并计数, 不会阻塞调用线程
+*/
+class BinaryLog
+{
+public:
+    // 把payload解码成参数, 按fmt格式化到out中
+    using FormatFunc = int (*)(const char *fmt, const char *payload, char *out, size_t len);
+
+    template <typename... Args>
+    static void record(int level, const char *fmt, Args... args);
+
+    // 启动/停止后台格式化线程, 停止前会把所有环形缓冲区中的记录处理完
+    static void start();
+    static void stop();
+
+    // 因环形缓冲区满而丢弃的记录数
+    static int64_t droppedRecords();
+
+    static const size_t kRingSize = 1024 * 1024;        // 每个线程的环形缓冲区大小
+    static const size_t kMaxStringArg = 1024;           // 字符串参数最多拷贝的长度
+private:
+    // 开始写一条记录, 返回payload的写入位置, 空间不足返回nullptr
+    static char* beginRecord(int level, const char *fmt, FormatFunc format, size_t payloadLen);
+    static void commitRecord();
+};
+
+namespace binlog
+{
+
+// 参数的编码方式, 默认直接按字节拷贝
+template <typename T>
+struct ArgCodec
+{
+    static_assert(std::is_trivially_copyable<T>::value, "binary log argument must be trivially copyable");
+    using Stored = T;
+
+    static size_t size(const T&) { return sizeof(T); }
+    static char* encode(char *p, const T &v)
+    {
+        memcpy(p, &v, sizeof v);
+        return p + sizeof v;
+    }
+    static const char* decode(const char *p, Stored *v)
+    {
+        memcpy(v, p, sizeof *v);
+        return p + sizeof *v;
+    }
+};
+
+// 字符串参数的生命周期不可控, 需要拷贝内容: uint32长度 + 字符 + '\0'
+struct StringCodec
+{
+    using Stored = const char*;
+
+    static size_t length(const char *s)
+    {
+        if (s == nullptr)
+        {
+            return 0;
+        }
+        size_t len = strnlen(s, BinaryLog::kMaxStringArg);
+        return len;
+    }
+    static size_t size(const char *s) { return sizeof(uint32_t) + length(s) + 1; }
+    static char* encode(char *p, const char *s)
+    {
+        uint32_t len = static_cast<uint32_t>(length(s));
+        memcpy(p, &len, sizeof len);
+        p += sizeof len;
+        if (len > 0)
+        {
+            memcpy(p, s, len);
+        }
+        p[len] = '\0';
+        return p + len + 1;
+    }
+    static const char* decode(const char *p, Stored *v)
+    {
+        uint32_t len;
+        memcpy(&len, p, sizeof len);
+        p += sizeof len;
+        *v = p;
+        return p + len + 1;
+    }
+};
+
+template <> struct ArgCodec<const char*> : StringCodec {};
+template <> struct ArgCodec<char*> : StringCodec {};
+
+template <size_t... I> struct IndexSeq {};
+template <size_t N, size_t... I> struct MakeIndexSeq : MakeIndexSeq<N - 1, N - 1, I...> {};
+template <size_t... I> struct MakeIndexSeq<0, I...> { using type = IndexSeq<I...>; };
+
+inline size_t payloadSize() { return 0; }
+
+template <typename T, typename... Rest>
+size_t payloadSize(const T &v, const Rest&... rest)
+{
+    return ArgCodec<T>::size(v) + payloadSize(rest...);
+}
+
+inline char* encodeArgs(char *p) { return p; }
+
+template <typename T, typename... Rest>
+char* encodeArgs(char *p, const T &v, const Rest&... rest)
+{
+    return encodeArgs(ArgCodec<T>::encode(p, v), rest...);
+}
+
+// 每一组参数类型实例化一个格式化函数, 函数指针随记录一起保存
+template <typename... Args>
+struct Formatter
+{
+    using Tuple = std::tuple<typename ArgCodec<Args>::Stored...>;
+
+    static int format(const char *fmt, const char *payload, char *out, size_t len)
+    {
+        return call(fmt, payload, out, len, typename MakeIndexSeq<sizeof...(Args)>::type());
+    }
+
+    template <size_t... I>
+    static int call(const char *fmt, const char *payload, char *out, size_t len, IndexSeq<I...>)
+    {
+        Tuple args;
+        const char *p = payload;
+        // 花括号初始化列表保证从左到右依次解码
+        int order[] = { 0, (p = ArgCodec<Args>::decode(p, &std::get<I>(args)), 0)... };
+        (void)order;
+        (void)p;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+        return snprintf(out, len, fmt, std::get<I>(args)...);
+#pragma GCC diagnostic pop
+    }
+};
+
+}
+
+template <typename... Args>
+void BinaryLog::record(int level, const char *fmt, Args... args)
+{
+    size_t len = binlog::payloadSize(args...);
+    char *payload = beginRecord(level, fmt, &binlog::Formatter<Args...>::format, len);
+    if (payload)
+    {
+        binlog::encodeArgs(payload, args...);
+        commitRecord();
+    }
+}
+
+#endif
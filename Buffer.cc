@@ -3,19 +3,135 @@
 #include <errno.h>
 #include <sys/uio.h>
 #include <unistd.h>
+#include <atomic>
+#include <memory>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BUFFER_SIMD_SEARCH 1
+#endif
+
+namespace
+{
+/*
+ * 分隔符查找: 先找首字节和末字节同时匹配的位置, 再用memcmp确认中间的字节
+ * 逐字节的版本用memchr跳到首字节, 用于没有SIMD的平台和SIMD处理剩下的尾巴
+*/
+const char* searchScalar(const char *p, const char *end, const char *delim, size_t len)
+{
+    const char *last = end - len;       // 最后一个可能的起始位置
+    while (p <= last)
+    {
+        p = static_cast<const char*>(memchr(p, delim[0], last - p + 1));
+        if (p == nullptr)
+        {
+            return nullptr;
+        }
+        if (memcmp(p + 1, delim + 1, len - 1) == 0)
+        {
+            return p;
+        }
+        ++p;
+    }
+    return nullptr;
+}
+
+#ifdef BUFFER_SIMD_SEARCH
+// 一次检查16个起始位置, 需要读到p + 16 + len - 1
+const char* searchSse2(const char *p, const char *end, const char *delim, size_t len)
+{
+    const __m128i first = _mm_set1_epi8(delim[0]);
+    const __m128i last = _mm_set1_epi8(delim[len - 1]);
+    while (static_cast<size_t>(end - p) >= 16 + len - 1)
+    {
+        __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + len - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last)));
+        while (mask != 0)
+        {
+            int i = __builtin_ctz(mask);
+            if (len <= 2 || memcmp(p + i + 1, delim + 1, len - 2) == 0)
+            {
+                return p + i;
+            }
+            mask &= mask - 1;
+        }
+        p += 16;
+    }
+    return searchScalar(p, end, delim, len);
+}
+
+// 和searchSse2相同, 一次检查32个起始位置, 只在CPU支持AVX2时调用
+__attribute__((target("avx2")))
+const char* searchAvx2(const char *p, const char *end, const char *delim, size_t len)
+{
+    const __m256i first = _mm256_set1_epi8(delim[0]);
+    const __m256i last = _mm256_set1_epi8(delim[len - 1]);
+    while (static_cast<size_t>(end - p) >= 32 + len - 1)
+    {
+        __m256i head = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i tail = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + len - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last)));
+        while (mask != 0)
+        {
+            int i = __builtin_ctz(mask);
+            if (len <= 2 || memcmp(p + i + 1, delim + 1, len - 2) == 0)
+            {
+                return p + i;
+            }
+            mask &= mask - 1;
+        }
+        p += 32;
+    }
+    return searchSse2(p, end, delim, len);
+}
+
+bool cpuHasAvx2()
+{
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+#endif
+
+std::atomic<size_t> g_extraBufferSize(Buffer::kExtraBufferSize);
+
+// 每个线程(也就是每个loop)一块额外空间, 第一次读的时候分配, 不清零
+struct ExtraBuffer
+{
+    std::unique_ptr<char[]> data;
+    size_t size = 0;
+};
+thread_local ExtraBuffer t_extraBuf;
+}
+
+void Buffer::setExtraBufferSize(size_t size)
+{
+    g_extraBufferSize.store(size);
+}
+
+size_t Buffer::extraBufferSize()
+{
+    return g_extraBufferSize.load(std::memory_order_relaxed);
+}
 
 /*
  * 从fd上读取数据, Poller工作在LT模式
  * Buffer缓冲区是有大小的, 但是从fd上读取数据的时候, 却不知道tcp数据最终的大小
  * 
  * @description: 从socket读到缓冲区的方法是使用readv先读至buffer_,
- * Buffer_空间如果不够会读入栈上65536个字节大小的空间, 然后以append的方式追加上buffer_,
+ * Buffer_空间如果不够会读入当前线程的额外空间(默认256k), 然后以append的方式追加上buffer_,
  * 考虑了避免系统调用带来的开销, 又不影响数据的接收
 */
 ssize_t Buffer::readFd(int fd, int* saveErrno)
 {
-    // 栈上的额外空间, 用于从套接字往出读时, 当buffer_暂时不够用时暂存数据, 待buffer_重新分配足够空间后, 把数据交换给buffer_
-    char extrabuf[65536] = { 0 };             // 栈上的内存空间 64k
+    // 线程的额外空间, 用于从套接字往出读时, 当buffer_暂时不够用时暂存数据, 待buffer_重新分配足够空间后, 把数据交换给buffer_
+    if (!t_extraBuf.data)
+    {
+        t_extraBuf.size = extraBufferSize();
+        t_extraBuf.data.reset(new char[t_extraBuf.size]);
+    }
+    char *extrabuf = t_extraBuf.data.get();
+    const size_t extraLen = t_extraBuf.size;
 
     /*
     struct iovec{
@@ -29,19 +145,22 @@ ssize_t Buffer::readFd(int fd, int* saveErrno)
 
     const size_t writable = writableBytes();    // 这是Buffer底层缓冲区剩余的可写空间的大小
                                                 
-    // 第一块缓冲区, 指向可写空间
-    vec[0].iov_base = begin() + writerIndex_;
-    vec[0].iov_len = writable;
+    // 第一块缓冲区, 指向可写空间; 还没有分配存储时直接读到额外空间
+    int idx = 0;
+    if (writable > 0)
+    {
+        vec[idx].iov_base = beginWrite();
+        vec[idx].iov_len = writable;
+        ++idx;
+    }
 
-    // 第二块缓冲区, 指向栈空间
-    vec[1].iov_base = extrabuf;
-    vec[1].iov_len = sizeof extrabuf;
+    // 第二块缓冲区, 指向线程的额外空间
+    vec[idx].iov_base = extrabuf;
+    vec[idx].iov_len = extraLen;
 
     // when there is enough space in this buffer, don't read into extrabuf.
-    // when extrabuf is used, we read 128k-1 bytes at most
-    // 这里之所以说最多128k-1字节, 那是因为若writetable为64k-1, 那么需要两个缓冲区 第一个为64k-1 第二个为64k, 所以最多128k-1
-    // 如果第一个缓冲区>=64k, 那就只采用一个缓冲区, 而不是用栈空间extrabuf[65536]的内容
-    const int iovcnt = (writable < sizeof extrabuf) ? 2 : 1;
+    // 如果第一个缓冲区不小于额外空间, 那就只采用一个缓冲区
+    const int iovcnt = (writable < extraLen) ? idx + 1 : 1;
     const ssize_t n = ::readv(fd, vec, iovcnt);
     if (n < 0)
     {
@@ -53,7 +172,7 @@ ssize_t Buffer::readFd(int fd, int* saveErrno)
     }
     else  // 表示extrabuf里面也写入了数据
     {
-        writerIndex_ = buffer_.size();
+        writerIndex_ += writable;
         append(extrabuf, n - writable);     // writerIndex_ 开始写 n - writable 大小的数据
     }
 
@@ -73,4 +192,26 @@ ssize_t Buffer::writeFd(int fd, int* saveErrno)
         *saveErrno = errno;
     }
     return n;
-}
\ No newline at end of file
+}
+
+const char* Buffer::findDelimiter(const char *start, const char *delim, size_t len) const
+{
+    const char *end = beginWrite();
+    if (len == 0)
+    {
+        return start;
+    }
+    if (static_cast<size_t>(end - start) < len)
+    {
+        return nullptr;
+    }
+    if (len == 1)
+    {
+        return static_cast<const char*>(memchr(start, delim[0], end - start));
+    }
+#ifdef BUFFER_SIMD_SEARCH
+    return cpuHasAvx2() ? searchAvx2(start, end, delim, len) : searchSse2(start, end, delim, len);
+#else
+    return searchScalar(start, end, delim, len);
+#endif
+}
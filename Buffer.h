@@ -1,9 +1,47 @@
 #ifndef _BUFFER_H_
 #define _BUFFER_H_
 
-#include <vector>
 #include <string>
+#include <memory>
 #include <algorithm>
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+#include "StringPiece.h"
+
+/*
+ * Buffer中一段数据的只读切片, 持有底层存储的引用计数
+ * 消息回调返回之后仍然有效, 可以交给其他线程处理, 或者通过TcpConnection::send(const BufferSlice&)转发, 都不拷贝
+ * 所有切片释放之后底层存储才会被回收
+*/
+class BufferSlice
+{
+public:
+    BufferSlice()
+        : data_(nullptr)
+        , size_(0)
+    {}
+    BufferSlice(std::shared_ptr<const char> storage, const char *data, size_t size)
+        : storage_(std::move(storage))
+        , data_(data)
+        , size_(size)
+    {}
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    // 可以作为TcpConnection::send的holder
+    const std::shared_ptr<const char>& storage() const { return storage_; }
+
+    StringPiece toStringPiece() const { return StringPiece(data_, size_); }
+    std::string toString() const { return std::string(data_, size_); }
+
+private:
+    std::shared_ptr<const char> storage_;
+    const char *data_;
+    size_t size_;
+};
 
 
 /*
@@ -19,18 +57,69 @@
  *  @endcode
 */
 // 网络库底层的缓冲器类型定义
+// 构造时不分配内存, 第一次写入时才分配; 读空之后超过kMaxRetainSize的存储会还给系统
+/*
+ * 存储平时由Buffer独占, 第一次切片(retrieveAsSlice)时才转为shared_ptr和切片共享
+ * 共享期间Buffer不会再改写已读部分: 需要搬移数据(makeSpace)或者向前写(prepend)时换一块新的存储,
+ * retrieveAll直接放弃这块存储, 旧存储在最后一个切片释放时回收
+*/
 class Buffer
 {
 public:
     static const size_t kCheapPrepend = 8;                      // 初始预留的prependable空间大小
     static const size_t kInitialSize = 1024;                    
+    static const size_t kMaxRetainSize = 64 * 1024;             // 读空之后默认还能保留的最大存储
+    static const size_t kExtraBufferSize = 256 * 1024;          // readFd每个线程额外空间的默认大小
+    static const size_t kSliceShareRatio = 2;                   // 切片至少占存储的1/2才共享存储, 否则拷贝
 
     explicit Buffer(size_t initialSize = kInitialSize)
-        : buffer_(kCheapPrepend + initialSize)
+        : data_(nullptr)
+        , capacity_(0)
+        , initialSize_(initialSize)
+        , maxRetainSize_(kMaxRetainSize)
         , readerIndex_(kCheapPrepend)
         , writerIndex_(kCheapPrepend)
     {}
 
+    // 拷贝只复制可读数据, 得到一块独占的存储
+    Buffer(const Buffer &rhs)
+        : Buffer(rhs.initialSize_)
+    {
+        maxRetainSize_ = rhs.maxRetainSize_;
+        append(rhs.peek(), rhs.readableBytes());
+    }
+
+    Buffer(Buffer &&rhs)
+        : Buffer(rhs.initialSize_)
+    {
+        maxRetainSize_ = rhs.maxRetainSize_;
+        swap(rhs);
+    }
+
+    Buffer& operator=(Buffer rhs)
+    {
+        swap(rhs);
+        initialSize_ = rhs.initialSize_;
+        maxRetainSize_ = rhs.maxRetainSize_;
+        return *this;
+    }
+
+    ~Buffer()
+    {
+        freeStorage();
+    }
+
+    // 只交换存储和读写位置, initialSize_和maxRetainSize_留在各自的Buffer上
+    // (比如send(Buffer*)换走loop共享的读缓冲区的存储之后, 它仍然保留自己的大小策略)
+    void swap(Buffer &rhs)
+    {
+        std::swap(data_, rhs.data_);
+        std::swap(capacity_, rhs.capacity_);
+        shared_.swap(rhs.shared_);
+        std::swap(readerIndex_, rhs.readerIndex_);
+        std::swap(writerIndex_, rhs.writerIndex_);
+    }
+
     size_t readableBytes() const
     {
         return writerIndex_ - readerIndex_;
@@ -38,7 +127,19 @@ public:
 
     size_t writableBytes() const 
     {
-        return buffer_.size() - writerIndex_;
+        return capacity_ == 0 ? 0 : capacity_ - writerIndex_;
+    }
+
+    // 当前占用的存储大小, 没有分配时为0
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    // 读空之后还能保留的最大存储, 超过的部分在retrieveAll时释放
+    void setMaxRetainSize(size_t size)
+    {
+        maxRetainSize_ = size;
     }
 
     size_t prependableBytes() const
@@ -68,6 +169,22 @@ public:
     void retrieveAll()
     {
         readerIndex_ = writerIndex_ = kCheapPrepend;
+        if (shared_ || capacity_ > kCheapPrepend + maxRetainSize_)
+        {
+            release();      // 存储还被切片引用时不能从头复用
+        }
+    }
+
+    // 把存储收缩到只容纳可读数据和reserve字节的可写空间, 没有数据且reserve为0时释放全部内存
+    void shrink(size_t reserve)
+    {
+        size_t readable = readableBytes();
+        if (readable == 0 && reserve == 0)
+        {
+            release();
+            return;
+        }
+        reallocate(kCheapPrepend + readable + reserve);
     }
 
     // 把onMessage函数上报的Buffer数据, 转成string类型的数据返回
@@ -83,7 +200,110 @@ public:
         return result;
     }
 
-    // buffer_.size()- writerIndex_
+    // 可读数据的视图, 不拷贝, 在下一次修改Buffer之前有效
+    StringPiece toStringPiece() const
+    {
+        return StringPiece(peek(), readableBytes());
+    }
+
+    /*
+     * 取走len字节作为切片, 切片在Buffer之后的修改和析构中保持有效
+     * 切片占存储的大部分时直接共享存储, 不拷贝; 小切片拷贝到大小刚好的新存储,
+     * 避免几个字节占住整块存储, 也避免存储转为共享之后读空时只能整块丢掉(下一次读又要重新分配)
+     * onMessage收到的可能是loop共享的读缓冲区, 只在回调里用的数据用toStringPiece, 不需要切片
+    */
+    BufferSlice retrieveAsSlice(size_t len)
+    {
+        if (len == 0)
+        {
+            return BufferSlice();
+        }
+        if (len * kSliceShareRatio < capacity_)
+        {
+            char *data = new char[len];
+            std::shared_ptr<const char> copy(data, std::default_delete<char[]>());
+            memcpy(data, peek(), len);
+            retrieve(len);
+            return BufferSlice(std::move(copy), data, len);
+        }
+        if (!shared_)
+        {
+            shared_.reset(data_, std::default_delete<char[]>());
+        }
+        BufferSlice slice(shared_, peek(), len);
+        retrieve(len);
+        return slice;
+    }
+
+    BufferSlice retrieveAllAsSlice()
+    {
+        return retrieveAsSlice(readableBytes());
+    }
+
+    // 丢弃[peek(), end)的数据, end必须在可读区间内, 一般是findCRLF等查找函数的返回值
+    void retrieveUntil(const char *end)
+    {
+        retrieve(end - peek());
+    }
+
+    /*
+     * 在可读数据中查找分隔符, 返回分隔符第一个字节的地址, 找不到返回nullptr
+     * 带start参数的版本从start开始查找, start必须在[peek(), beginWrite()]之间
+     * x86上用SSE2/AVX2一次比较16/32个字节的首尾两个字符, 其他平台退回memchr
+    */
+    const char* findCRLF() const { return findDelimiter(peek(), "\r\n", 2); }
+    const char* findCRLF(const char *start) const { return findDelimiter(start, "\r\n", 2); }
+    const char* findEOL() const { return findEOL(peek()); }
+    const char* findEOL(const char *start) const
+    {
+        return static_cast<const char*>(memchr(start, '\n', beginWrite() - start));
+    }
+    const char* findDelimiter(const char *delim, size_t len) const { return findDelimiter(peek(), delim, len); }
+    const char* findDelimiter(const char *start, const char *delim, size_t len) const;
+
+    /*
+     * 网络字节序(大端)的整数读写
+     * peek/read要求可读数据不少于对应的字节数, 由调用者保证
+     * prepend写到可读数据前面的kCheapPrepend预留空间中, 用于先写消息体再补长度头
+    */
+    void appendInt64(int64_t x) { uint64_t be = htobe64(x); append(reinterpret_cast<const char*>(&be), sizeof be); }
+    void appendInt32(int32_t x) { uint32_t be = htobe32(x); append(reinterpret_cast<const char*>(&be), sizeof be); }
+    void appendInt16(int16_t x) { uint16_t be = htobe16(x); append(reinterpret_cast<const char*>(&be), sizeof be); }
+    void appendInt8(int8_t x) { append(reinterpret_cast<const char*>(&x), sizeof x); }
+
+    int64_t peekInt64() const { uint64_t be; memcpy(&be, peek(), sizeof be); return be64toh(be); }
+    int32_t peekInt32() const { uint32_t be; memcpy(&be, peek(), sizeof be); return be32toh(be); }
+    int16_t peekInt16() const { uint16_t be; memcpy(&be, peek(), sizeof be); return be16toh(be); }
+    int8_t peekInt8() const { return *peek(); }
+
+    int64_t readInt64() { int64_t x = peekInt64(); retrieve(sizeof x); return x; }
+    int32_t readInt32() { int32_t x = peekInt32(); retrieve(sizeof x); return x; }
+    int16_t readInt16() { int16_t x = peekInt16(); retrieve(sizeof x); return x; }
+    int8_t readInt8() { int8_t x = peekInt8(); retrieve(sizeof x); return x; }
+
+    void prependInt64(int64_t x) { uint64_t be = htobe64(x); prepend(&be, sizeof be); }
+    void prependInt32(int32_t x) { uint32_t be = htobe32(x); prepend(&be, sizeof be); }
+    void prependInt16(int16_t x) { uint16_t be = htobe16(x); prepend(&be, sizeof be); }
+    void prependInt8(int8_t x) { prepend(&x, sizeof x); }
+
+    // 把[data, data+len]写到可读数据的前面, len不能超过prependableBytes()
+    void prepend(const void *data, size_t len)
+    {
+        if (capacity_ == 0)
+        {
+            makeSpace(0);       // 还没有分配存储, 预留空间也还不存在
+        }
+        else if (shared_)
+        {
+            // 可读数据前面的字节可能属于某个切片, 换一块存储并保留足够的预留空间
+            size_t room = len > kCheapPrepend ? len : kCheapPrepend;
+            reallocate(room + readableBytes() + writableBytes(), room);
+        }
+        readerIndex_ -= len;
+        memcpy(begin() + readerIndex_, data, len);
+    }
+
+    // capacity_ - writerIndex_
     void ensureWritableBytes(size_t len)
     {
         if (writableBytes() < len)
@@ -114,26 +334,74 @@ public:
     ssize_t readFd(int fd, int* saveErrno);
     // 通过fd发送数据
     ssize_t writeFd(int fd, int* saveErrno);
+
+    // readFd额外空间的大小, 每个线程第一次读的时候按这个大小分配, 需要在loop线程开始读之前设置
+    static void setExtraBufferSize(size_t size);
+    static size_t extraBufferSize();
 private:
     char* begin()
     {
-        // it.operator*()
-        return &*buffer_.begin();       // vector底层数组首元素的地址, 也就是数组的起始地址
+        return data_;                   // 底层数组的起始地址, 还没分配时为nullptr
     }
     const char* begin() const 
     {
-        return &*buffer_.begin();
+        return data_;
+    }
+
+    // 放弃当前的存储: 独占时直接释放, 共享时只减少引用计数
+    void freeStorage()
+    {
+        if (shared_)
+        {
+            shared_.reset();
+        }
+        else
+        {
+            delete[] data_;
+        }
+        data_ = nullptr;
+        capacity_ = 0;
+    }
+
+    void release()
+    {
+        freeStorage();
+        readerIndex_ = writerIndex_ = kCheapPrepend;
+    }
+
+    // 换一块capacity大小的独占存储, 可读数据搬到prepend处, capacity不能小于prepend + readableBytes()
+    void reallocate(size_t capacity, size_t prepend = kCheapPrepend)
+    {
+        size_t readable = readableBytes();
+        char *data = new char[capacity];
+        std::copy(peek(), peek() + readable, data + prepend);
+        freeStorage();
+        data_ = data;
+        capacity_ = capacity;
+        readerIndex_ = prepend;
+        writerIndex_ = readerIndex_ + readable;
     }
 
     void makeSpace(size_t len)
     {
+        if (capacity_ == 0)
+        {
+            capacity_ = kCheapPrepend + std::max(len, initialSize_);
+            data_ = new char[capacity_];        // 不清零
+            return;
+        }
         /*
         | kCheapPrepend | xxxx | reader | writer |      // xxxx表示reader中的已读部分
         | kCheapPrepend | reader |       len             |
         */
         if (writableBytes() + prependableBytes() < len + kCheapPrepend)     // len > xxxx前面剩余部分 + write部分
         {
-            buffer_.resize(writerIndex_ + len);
+            // 和vector一样按倍数增长, 连续的小append均摊下来不会反复拷贝
+            reallocate(std::max(kCheapPrepend + readableBytes() + len, 2 * capacity_));
+        }
+        else if (shared_)       // 已读部分可能属于某个切片, 不能原地搬移
+        {
+            reallocate(capacity_);
         }
         else        // len <= xxxx + write 把reader搬到从xxxx开始, 使得xxxx后面是一段连续的空间
         {
@@ -147,7 +415,11 @@ private:
         }
     }
 
-    std::vector<char> buffer_;
+    char *data_;
+    size_t capacity_;
+    std::shared_ptr<char> shared_;          // 切片过之后由它持有data_, 否则为空, data_由Buffer独占
+    size_t initialSize_;
+    size_t maxRetainSize_;
     size_t readerIndex_;
     size_t writerIndex_;
 };
@@ -19,4 +19,6 @@ using MessageCallback = std::function<void (const TcpConnectionPtr&,
 
 using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
 
+using TimerCallback = std::function<void()>;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,264 @@
+#include "ChainBuffer.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+
+#include "Logger.h"
+
+ChainBuffer::ChainBuffer()
+    : head_(0)
+    , readable_(0)
+    , spare_(nullptr)
+    , zeroCopyThreshold_(0)
+    , zeroCopySeq_(0)
+{
+}
+
+ChainBuffer::~ChainBuffer()
+{
+    retrieveAll();
+    delete[] spare_;
+}
+
+void ChainBuffer::append(const char *data, size_t len)
+{
+    readable_ += len;
+
+    // 先填满最后一个chunk的剩余空间
+    if (!nodes_.empty() && nodes_.back().chunk != nullptr && nodes_.back().fd < 0)
+    {
+        Node &tail = nodes_.back();
+        size_t avail = tail.chunk + kChunkSize - (tail.data + tail.size);
+        size_t n = len < avail ? len : avail;
+        memcpy(const_cast<char*>(tail.data) + tail.size, data, n);
+        tail.size += n;
+        data += n;
+        len -= n;
+    }
+
+    while (len > 0)
+    {
+        Node node;
+        node.chunk = allocChunk();
+        node.data = node.chunk;
+        node.fd = -1;
+        node.offset = 0;
+        node.size = len < kChunkSize ? len : kChunkSize;
+        memcpy(node.chunk, data, node.size);
+        data += node.size;
+        len -= node.size;
+        nodes_.push_back(std::move(node));
+    }
+}
+
+void ChainBuffer::appendBlock(const char *data, size_t len, std::shared_ptr<const void> holder)
+{
+    if (len == 0)
+    {
+        return;
+    }
+    Node node;
+    node.data = data;
+    node.size = len;
+    node.chunk = nullptr;
+    node.holder = std::move(holder);
+    node.fd = -1;
+    node.offset = 0;
+    nodes_.push_back(std::move(node));
+    readable_ += len;
+}
+
+void ChainBuffer::appendFile(int fd, off_t offset, size_t len)
+{
+    if (len == 0)
+    {
+        ::close(fd);
+        return;
+    }
+    Node node;
+    node.data = nullptr;
+    node.size = len;
+    node.chunk = nullptr;
+    node.fd = fd;
+    node.offset = offset;
+    nodes_.push_back(std::move(node));
+    readable_ += len;
+}
+
+void ChainBuffer::retrieve(size_t len)
+{
+    if (len >= readable_)
+    {
+        retrieveAll();
+        return;
+    }
+
+    readable_ -= len;
+    while (len > 0)
+    {
+        Node &front = nodes_[head_];
+        if (len < front.size)
+        {
+            if (front.fd >= 0)
+            {
+                front.offset += len;
+            }
+            else
+            {
+                front.data += len;
+            }
+            front.size -= len;
+            break;
+        }
+        len -= front.size;
+        popFront();
+    }
+}
+
+void ChainBuffer::retrieveAll()
+{
+    while (!nodes_.empty())
+    {
+        popFront();
+    }
+    readable_ = 0;
+}
+
+int ChainBuffer::fillIovec(struct iovec *iov, int maxIov) const
+{
+    int n = 0;
+    for (auto it = nodes_.begin() + head_; it != nodes_.end() && n < maxIov && it->fd < 0; ++it, ++n)
+    {
+        iov[n].iov_base = const_cast<char*>(it->data);
+        iov[n].iov_len = it->size;
+    }
+    return n;
+}
+
+ssize_t ChainBuffer::writeFd(int fd, int* saveErrno)
+{
+    ssize_t n = -1;
+    if (zeroCopyThreshold_ > 0 && !nodes_.empty() && nodes_[head_].holder
+        && nodes_[head_].size >= zeroCopyThreshold_)
+    {
+        const Node &front = nodes_[head_];
+        struct iovec vec;
+        vec.iov_base = const_cast<char*>(front.data);
+        vec.iov_len = front.size;
+        struct msghdr msg = {};
+        msg.msg_iov = &vec;
+        msg.msg_iovlen = 1;
+        n = ::sendmsg(fd, &msg, MSG_ZEROCOPY);
+        if (n > 0)
+        {
+            // 内核还引用着这块内存, holder等完成通知之后再释放
+            zeroCopyPending_.push_back(std::make_pair(zeroCopySeq_++, front.holder));
+            return n;
+        }
+        if (n < 0 && errno != ENOBUFS)
+        {
+            *saveErrno = errno;
+            return n;
+        }
+        // ENOBUFS: 超过了optmem限制, 这次按普通方式发送
+    }
+
+    if (frontIsFile())
+    {
+        // sendfile不修改传入的offset以外的状态, 发送成功的部分由retrieve推进offset
+        const Node &front = nodes_[head_];
+        off_t offset = front.offset;
+        n = ::sendfile(fd, front.fd, &offset, front.size);
+        if (n == 0)
+        {
+            // 文件比登记的长度短(被截断了), 剩下的数据永远发不出去
+            errno = EIO;
+            n = -1;
+        }
+    }
+    else
+    {
+        struct iovec vec[IOV_MAX];
+        int iovcnt = fillIovec(vec, IOV_MAX);
+        n = iovcnt == 1 ? ::write(fd, vec[0].iov_base, vec[0].iov_len) : ::writev(fd, vec, iovcnt);
+    }
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+    return n;
+}
+
+char* ChainBuffer::allocChunk()
+{
+    if (spare_ != nullptr)
+    {
+        char *chunk = spare_;
+        spare_ = nullptr;
+        return chunk;
+    }
+    return new char[kChunkSize];
+}
+
+void ChainBuffer::freeChunk(char *chunk)
+{
+    if (spare_ == nullptr)
+    {
+        spare_ = chunk;
+    }
+    else
+    {
+        delete[] chunk;
+    }
+}
+
+void ChainBuffer::popFront()
+{
+    Node &front = nodes_[head_];
+    if (front.chunk != nullptr)
+    {
+        freeChunk(front.chunk);
+        front.chunk = nullptr;
+    }
+    if (front.fd >= 0)
+    {
+        ::close(front.fd);
+        front.fd = -1;
+    }
+    front.holder.reset();
+    ++head_;
+
+    if (head_ == nodes_.size())
+    {
+        // 数据发完了, 空闲的连接不保留任何内存
+        std::vector<Node>().swap(nodes_);
+        head_ = 0;
+        delete[] spare_;
+        spare_ = nullptr;
+    }
+    else if (head_ >= kCompactNodes && head_ * 2 >= nodes_.size())
+    {
+        nodes_.erase(nodes_.begin(), nodes_.begin() + head_);
+        head_ = 0;
+    }
+}
+
+void ChainBuffer::zeroCopyCompleted(uint32_t lo, uint32_t hi)
+{
+    // TCP的完成通知按序号递增, 可能合并成一个区间; 区间应当从最早一个等待中的发送开始
+    if (!zeroCopyPending_.empty() && zeroCopyPending_.front().first != lo)
+    {
+        LOG_ERROR("ChainBuffer::zeroCopyCompleted notification [%u, %u] does not start at pending seq %u \n",
+            lo, hi, zeroCopyPending_.front().first);
+    }
+    auto it = zeroCopyPending_.begin();
+    while (it != zeroCopyPending_.end() && static_cast<int32_t>(it->first - hi) <= 0)
+    {
+        ++it;
+    }
+    zeroCopyPending_.erase(zeroCopyPending_.begin(), it);
+}
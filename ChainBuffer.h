@@ -0,0 +1,96 @@
+#ifndef _CHAINBUFFER_H_
+#define _CHAINBUFFER_H_
+
+#include <vector>
+#include <memory>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "noncopyable.h"
+
+/*
+ * 发送缓冲区, 由一串节点组成
+ *  +---------+---------+----------------+---------+
+ *  |  chunk  |  chunk  | external block |  chunk  |
+ *  +---------+---------+----------------+---------+
+ *  ^ 发送位置                                     ^ 追加位置
+ *
+ * chunk: 固定大小的内存块, append的数据拷贝进最后一个chunk, 放不下再分配新的chunk
+ * external block: 引用用户的内存, 由holder保证发送完之前不被释放, 不拷贝
+ * file: 文件中的一段, 发送时用sendfile直接从page cache发出, 不经过用户空间
+ * 
+ * 已经进入缓冲区的数据不会再被移动或重新分配, 发送时用writev一次最多提交IOV_MAX个节点,
+ * 遇到file节点时writev在它前面停下, 轮到file节点时用sendfile发送
+ *
+ * 没有数据时不占用堆内存, 数据发完之后节点数组和空闲chunk都会释放
+ *
+ * 开启zerocopy之后, 不小于阈值的external block用MSG_ZEROCOPY发送, 内核直接引用这块内存,
+ * 发送之后holder转到等待队列, 直到内核通过MSG_ERRQUEUE通知完成(zeroCopyCompleted)才释放
+*/
+class ChainBuffer : noncopyable
+{
+public:
+    static const size_t kChunkSize = 64 * 1024;
+
+    ChainBuffer();
+    ~ChainBuffer();
+
+    size_t readableBytes() const { return readable_; }
+    bool empty() const { return readable_ == 0; }
+    // 节点个数
+    size_t numNodes() const { return nodes_.size() - head_; }
+
+    // 拷贝[data, data+len]到缓冲区的末尾
+    void append(const char *data, size_t len);
+    // 引用[data, data+len], 不拷贝, holder在这段数据发送完之后释放
+    void appendBlock(const char *data, size_t len, std::shared_ptr<const void> holder);
+    // 文件fd中[offset, offset+len]的数据, 缓冲区接管fd, 发送完之后关闭
+    void appendFile(int fd, off_t offset, size_t len);
+    // 第一个节点是不是file节点
+    bool frontIsFile() const { return !nodes_.empty() && nodes_[head_].fd >= 0; }
+
+    // 丢弃前面len个字节
+    void retrieve(size_t len);
+    void retrieveAll();
+
+    // 用前面的内存数据填写iovec, 最多maxIov个, 遇到file节点停止, 返回填写的个数
+    int fillIovec(struct iovec *iov, int maxIov) const;
+    // 通过fd发送数据, 和Buffer::writeFd一样, 发送成功的部分由调用方retrieve
+    ssize_t writeFd(int fd, int* saveErrno);
+
+    // 不小于threshold的external block用MSG_ZEROCOPY发送, 0表示关闭, socket需要先开启SO_ZEROCOPY
+    void setZeroCopyThreshold(size_t threshold) { zeroCopyThreshold_ = threshold; }
+    size_t zeroCopyThreshold() const { return zeroCopyThreshold_; }
+    // 内核通知序号[lo, hi]的zerocopy发送已经完成
+    void zeroCopyCompleted(uint32_t lo, uint32_t hi);
+    // 还在等待内核通知的zerocopy发送个数
+    size_t zeroCopyPending() const { return zeroCopyPending_.size(); }
+private:
+    struct Node
+    {
+        const char *data;                   // 可读数据的起始地址
+        size_t size;                        // 可读字节数
+        char *chunk;                        // 自己分配的chunk, external block为nullptr
+        std::shared_ptr<const void> holder; // external block的持有者
+        int fd;                             // file节点的文件, 其他节点为-1
+        off_t offset;                       // file节点下一个要发送的位置
+    };
+
+    char* allocChunk();
+    void freeChunk(char *chunk);
+    void popFront();
+
+    static const size_t kCompactNodes = 32;   // 数组前面已经发完的节点超过这个数量并且超过一半时整理一次
+
+    std::vector<Node> nodes_;               // [head_, size)是有效节点
+    size_t head_;
+    size_t readable_;
+    char *spare_;                           // 留一个空闲的chunk, 避免反复分配
+
+    size_t zeroCopyThreshold_;
+    uint32_t zeroCopySeq_;                  // 下一次MSG_ZEROCOPY发送的序号, 和内核的计数保持一致
+    std::vector<std::pair<uint32_t, std::shared_ptr<const void>>> zeroCopyPending_;
+};
+
+#endif
@@ -11,12 +11,15 @@ const int Channel::kWriteEvent = EPOLLOUT;
 
 // EventLoop: ChannelList Poller
 Channel::Channel(EventLoop *loop, int fd)
-    : loop_(loop)
-    , fd_(fd)
+    : fd_(fd)
     , events_(0)
     , revents_(0)
     , index_(-1)
+    , registered_(kNoneEvent)
+    , edgeTriggered_(false)
+    , exclusive_(false)
     , tied_(false)
+    , loop_(loop)
 { 
 }
 
@@ -42,10 +45,32 @@ EventLoop => ChannelList  Poller
 */
 void Channel::update()
 {
+    registered_ = registeredEvents();
     // 通过Channel所属的EventLoop，调用poller的相应方法，注册fd的events事件
     loop_->updateChannel(this);
 }
 
+int Channel::registeredEvents() const
+{
+    if (events_ == kNoneEvent)
+    {
+        return events_;
+    }
+    // EPOLLEXCLUSIVE不能和EPOLLPRI一起注册, 监听socket也没有带外数据
+    int events = exclusive_ ? (events_ & ~EPOLLPRI) | EPOLLEXCLUSIVE : events_;
+    return edgeTriggered_ ? events | kWriteEvent | EPOLLET : events;
+}
+
+void Channel::updateInterest()
+{
+    // ET模式下只改变了写兴趣, 注册的事件不变, 省掉一次epoll_ctl
+    if (edgeTriggered_ && registeredEvents() == registered_)
+    {
+        return;
+    }
+    update();
+}
+
 void Channel::remove()
 {
     // 在Channel所属的EventLoop中，把当前的Channel删除掉
@@ -72,7 +97,7 @@ void Channel::handleEvent(Timestamp receiveTime)
 // 根据poller通知的Channel发生的具体事件，由Channel负责调用具体的回调操作
 void Channel::handlerEventWithGuard(Timestamp receiveTime)
 {
-    LOG_INFO("Channel handleEvent revents:%d", revents_);
+    LOG_DEBUG("Channel handleEvent revents:%d", revents_);
 
     if ((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN))
     {
@@ -98,7 +123,8 @@ void Channel::handlerEventWithGuard(Timestamp receiveTime)
         }
     }
 
-    if (revents_ & EPOLLOUT)
+    // ET模式下EPOLLOUT一直注册着, 只有有写兴趣时才回调
+    if ((revents_ & EPOLLOUT) && (!edgeTriggered_ || isWriting()))
     {
         if (writeCallback_)
         {
@@ -40,12 +40,26 @@ public:
     int events() const { return events_;}
     void set_revents(int revt) { revents_ = revt; }
 
+    /*
+     * 边沿触发模式(EPOLLET), 需要在注册到poller之前设置
+     * ET模式下只要有感兴趣的事件, EPOLLOUT就一直注册在epoll中, 写兴趣只是Channel本地的标记,
+     * enableWriting/disableWriting不再产生EPOLL_CTL_MOD, 没有写兴趣时收到的EPOLLOUT直接忽略
+     * 使用ET模式的一方必须把数据读/写到EAGAIN为止, 否则不会再收到通知
+    */
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+    bool edgeTriggered() const { return edgeTriggered_; }
+    // 实际注册到poller中的事件
+    int registeredEvents() const;
+
+    // 注册时带上EPOLLEXCLUSIVE, 只用于多个loop共享的监听socket; 需要在注册到poller之前设置, 之后不能再修改事件
+    void setExclusive(bool on) { exclusive_ = on; }
+
     // 将Channel中的文件描述符及其感兴趣的事件注册到事件监听器上, 或从事件监听器上移除
-    void enableReading() { events_ |= kReadEvent; update(); }
-    void disableReading() { events_ &= ~kReadEvent; update(); }
-    void enableWriting() { events_ |= kWriteEvent; update(); }
-    void disableWriting() { events_ &= ~kWriteEvent; update(); }
-    void disableAll() { events_ = kNoneEvent; update(); }
+    void enableReading() { events_ |= kReadEvent; updateInterest(); }
+    void disableReading() { events_ &= ~kReadEvent; updateInterest(); }
+    void enableWriting() { events_ |= kWriteEvent; updateInterest(); }
+    void disableWriting() { events_ &= ~kWriteEvent; updateInterest(); }
+    void disableAll() { events_ = kNoneEvent; updateInterest(); }
 
     // 返回fd当前的事件状态
     bool isNoneEvent() const { return events_ == kNoneEvent; }
@@ -62,29 +76,37 @@ public:
     */
     // one loop per thread
     EventLoop* ownerLoop() { return loop_; }
+    // 连接迁移时使用, 必须已经从原loop的poller中remove
+    void setOwnerLoop(EventLoop *loop) { loop_ = loop; }
     void remove();
 private:
     void update();                  // 本质调用epoll_ctl()
+    // 感兴趣的事件改变了, 只有注册到poller中的事件也改变时才调用update
+    void updateInterest();
     void handlerEventWithGuard(Timestamp receiveTime);
     
     static const int kNoneEvent;
     static const int kReadEvent;
     static const int kWriteEvent;
 
-    EventLoop* loop_;               // 事件循环
+    // poller和handleEvent每次都要访问的成员放在最前面, 连同readCallback_一起落在前两个cache line内
     const int fd_;                  // fd, Poller监听的对象
     int events_;                    // 注册fd感兴趣的事件
     int revents_;                   // poller返回的具体发生事件
     int index_;
-
-    std::weak_ptr<void> tie_;
+    int registered_;                // 上一次注册到poller中的事件
+    bool edgeTriggered_;
+    bool exclusive_;
     bool tied_;
+    std::weak_ptr<void> tie_;
 
     // 因为Channel通道里面能够获得fd最终发生的具体事件revents，所以它负责调用具体事件的回调操作
     ReadEventCallback readCallback_;
     EventCallback writeCallback_;
     EventCallback closeCallback_;
     EventCallback errorCallback_;
+
+    EventLoop* loop_;               // 事件循环, 只在修改注册的事件时使用
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,283 @@
+#include "Connector.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+
+#include "Logger.h"
+#include "Channel.h"
+#include "EventLoop.h"
+
+static int createNonblocking()
+{
+    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d connect socket create err:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+static int getSocketError(int sockfd)
+{
+    int optval;
+    socklen_t optlen = sizeof optval;
+    if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    {
+        return errno;
+    }
+    return optval;
+}
+
+// 连接本机地址时, 内核可能恰好选中和目标相同的临时端口, 形成TCP同时打开, 自己连上自己
+static bool isSelfConnect(int sockfd)
+{
+    sockaddr_in local, peer;
+    ::bzero(&local, sizeof local);
+    ::bzero(&peer, sizeof peer);
+    socklen_t addrlen = sizeof local;
+    if (::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0)
+    {
+        return false;
+    }
+    addrlen = sizeof peer;
+    if (::getpeername(sockfd, (sockaddr*)&peer, &addrlen) < 0)
+    {
+        return false;
+    }
+    return local.sin_port == peer.sin_port && local.sin_addr.s_addr == peer.sin_addr.s_addr;
+}
+
+const int Connector::kMaxRetryDelayMs;
+const int Connector::kInitRetryDelayMs;
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
+    : loop_(loop)
+    , serverAddr_(serverAddr)
+    , connect_(false)
+    , state_(kDisconnected)
+    , retryDelayMs_(kInitRetryDelayMs)
+    , attempts_(0)
+    , established_(0)
+    , failures_(0)
+    , selfConnects_(0)
+    , retries_(0)
+    , lastConnectMicros_(0)
+    , totalConnectMicros_(0)
+{
+    LOG_DEBUG("Connector::ctor[%p] \n", this);
+}
+
+Connector::~Connector()
+{
+    LOG_DEBUG("Connector::dtor[%p] \n", this);
+    if (channel_)
+    {
+        LOG_ERROR("Connector::dtor[%p] still connecting to %s \n", this, serverAddr_.toIpPort().c_str());
+    }
+}
+
+Connector::Stats Connector::stats() const
+{
+    Stats s;
+    s.attempts = attempts_.load(std::memory_order_relaxed);
+    s.established = established_.load(std::memory_order_relaxed);
+    s.failures = failures_.load(std::memory_order_relaxed);
+    s.selfConnects = selfConnects_.load(std::memory_order_relaxed);
+    s.retries = retries_.load(std::memory_order_relaxed);
+    s.lastConnectMicros = lastConnectMicros_.load(std::memory_order_relaxed);
+    s.totalConnectMicros = totalConnectMicros_.load(std::memory_order_relaxed);
+    return s;
+}
+
+void Connector::start()
+{
+    connect_ = true;
+    loop_->runInLoop(std::bind(&Connector::startInLoop, shared_from_this()));
+}
+
+void Connector::startInLoop()
+{
+    if (state_ != kDisconnected)
+    {
+        return;
+    }
+    if (connect_)
+    {
+        connect();
+    }
+    else
+    {
+        LOG_DEBUG("Connector::startInLoop do not connect \n");
+    }
+}
+
+// 连接断开后由TcpClient在loop线程中调用, 重新从最短的退避时间开始
+void Connector::restart()
+{
+    setState(kDisconnected);
+    retryDelayMs_ = kInitRetryDelayMs;
+    connect_ = true;
+    startInLoop();
+}
+
+void Connector::stop()
+{
+    connect_ = false;
+    loop_->queueInLoop(std::bind(&Connector::stopInLoop, shared_from_this()));
+}
+
+void Connector::stopInLoop()
+{
+    loop_->cancel(retryTimer_);
+    if (state_ == kConnecting)
+    {
+        setState(kDisconnected);
+        int sockfd = removeAndResetChannel();
+        ::close(sockfd);
+    }
+}
+
+void Connector::connect()
+{
+    int sockfd = createNonblocking();
+    ++attempts_;
+    connectStart_ = Timestamp::now();
+    int ret = ::connect(sockfd, (sockaddr*)serverAddr_.getSockAddr(), sizeof(sockaddr_in));
+    int savedErrno = (ret == 0) ? 0 : errno;
+    switch (savedErrno)
+    {
+    case 0:
+    case EINPROGRESS:
+    case EINTR:
+    case EISCONN:
+        connecting(sockfd);
+        break;
+
+    // 临时性的错误, 稍后重试
+    case EAGAIN:
+    case EADDRINUSE:
+    case EADDRNOTAVAIL:
+    case ECONNREFUSED:
+    case ENETUNREACH:
+    case ETIMEDOUT:
+        retry(sockfd);
+        break;
+
+    // 参数或者权限错误, 重试也不会成功
+    default:
+        LOG_ERROR("Connector::connect to %s failed, errno:%d %s \n",
+            serverAddr_.toIpPort().c_str(), savedErrno, strerror(savedErrno));
+        ++failures_;
+        ::close(sockfd);
+        break;
+    }
+}
+
+void Connector::connecting(int sockfd)
+{
+    setState(kConnecting);
+    channel_.reset(new Channel(loop_, sockfd));
+    channel_->setWriteCallback(std::bind(&Connector::handleWrite, this));
+    channel_->setErrorCallback(std::bind(&Connector::handleError, this));
+    // connect完成(成功或失败)时sockfd变为可写
+    channel_->enableWriting();
+}
+
+int Connector::removeAndResetChannel()
+{
+    channel_->disableAll();
+    channel_->remove();
+    int sockfd = channel_->fd();
+    // 当前可能正在Channel::handleEvent中, 不能在这里析构channel_
+    loop_->queueInLoop(std::bind(&Connector::resetChannel, shared_from_this()));
+    return sockfd;
+}
+
+void Connector::resetChannel()
+{
+    channel_.reset();
+}
+
+void Connector::handleWrite()
+{
+    if (state_ != kConnecting)
+    {
+        return;
+    }
+
+    int sockfd = removeAndResetChannel();
+    int err = getSocketError(sockfd);
+    if (err)
+    {
+        LOG_ERROR("Connector::handleWrite connect to %s SO_ERROR:%d %s \n",
+            serverAddr_.toIpPort().c_str(), err, strerror(err));
+        retry(sockfd);
+    }
+    else if (isSelfConnect(sockfd))
+    {
+        LOG_ERROR("Connector::handleWrite self connect to %s \n", serverAddr_.toIpPort().c_str());
+        ++selfConnects_;
+        retry(sockfd);
+    }
+    else
+    {
+        setState(kConnected);
+        int64_t micros = Timestamp::now().microSecondsSinceEpoch() - connectStart_.microSecondsSinceEpoch();
+        lastConnectMicros_.store(micros, std::memory_order_relaxed);
+        totalConnectMicros_ += micros;
+        ++established_;
+        retryDelayMs_ = kInitRetryDelayMs;
+        if (connect_ && newConnectionCallback_)
+        {
+            newConnectionCallback_(sockfd);
+        }
+        else
+        {
+            ::close(sockfd);
+        }
+    }
+}
+
+void Connector::handleError()
+{
+    LOG_ERROR("Connector::handleError state=%d \n", (int)state_);
+    if (state_ == kConnecting)
+    {
+        int sockfd = removeAndResetChannel();
+        int err = getSocketError(sockfd);
+        LOG_DEBUG("Connector::handleError SO_ERROR:%d %s \n", err, strerror(err));
+        retry(sockfd);
+    }
+}
+
+void Connector::retry(int sockfd)
+{
+    ::close(sockfd);
+    ++failures_;
+    setState(kDisconnected);
+    if (connect_)
+    {
+        LOG_INFO("Connector::retry connecting to %s in %d milliseconds \n",
+            serverAddr_.toIpPort().c_str(), retryDelayMs_);
+        ++retries_;
+        // 定时器只持有弱引用, Connector先析构时重试自动作废
+        std::weak_ptr<Connector> weakSelf(shared_from_this());
+        retryTimer_ = loop_->runAfter(retryDelayMs_ / 1000.0, [weakSelf] {
+            std::shared_ptr<Connector> self = weakSelf.lock();
+            if (self)
+            {
+                self->startInLoop();
+            }
+        });
+        retryDelayMs_ = std::min(retryDelayMs_ * 2, kMaxRetryDelayMs);
+    }
+    else
+    {
+        LOG_DEBUG("Connector::retry do not connect \n");
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef _CONNECTOR_H_
+#define _CONNECTOR_H_
+
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <stdint.h>
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "Timestamp.h"
+#include "TimerId.h"
+
+class Channel;
+class EventLoop;
+
+/*
+ * 主动发起连接, TcpClient使用
+ * 非阻塞connect之后用Channel关注可写事件, 可写时用SO_ERROR确认结果, 并排除自连接(本地端口恰好等于目标端口)
+ * 失败后按指数退避重试: 从kInitRetryDelayMs开始每次翻倍, 最多kMaxRetryDelayMs
+ * 连接成功只把sockfd交给NewConnectionCallback, 之后socket归回调方所有
+ * start/stop可以在任意线程调用, restart只能在loop线程调用
+*/
+class Connector : noncopyable, public std::enable_shared_from_this<Connector>
+{
+public:
+    using NewConnectionCallback = std::function<void(int sockfd)>;
+
+    // 连接建立的统计, 可以在任意线程读取
+    struct Stats
+    {
+        int64_t attempts;           // 发起的connect次数
+        int64_t established;        // 成功建立的连接数
+        int64_t failures;           // 失败次数(包括拒绝、超时、自连接等)
+        int64_t selfConnects;       // 其中自连接的次数
+        int64_t retries;            // 安排的重试次数
+        int64_t lastConnectMicros;  // 最近一次成功连接从connect到可写的耗时
+        int64_t totalConnectMicros; // 所有成功连接的耗时之和, 除以established即平均耗时
+    };
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback &cb) { newConnectionCallback_ = cb; }
+
+    const InetAddress& serverAddress() const { return serverAddr_; }
+    Stats stats() const;
+
+    void start();
+    void restart();
+    void stop();
+
+    static const int kMaxRetryDelayMs = 30 * 1000;
+    static const int kInitRetryDelayMs = 500;
+
+private:
+    enum States { kDisconnected, kConnecting, kConnected };
+
+    void setState(States s) { state_ = s; }
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    void retry(int sockfd);
+    int removeAndResetChannel();
+    void resetChannel();
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::atomic_bool connect_;
+    States state_;
+    std::unique_ptr<Channel> channel_;              // 每次尝试使用新的sockfd, 也对应新的Channel
+    NewConnectionCallback newConnectionCallback_;
+    int retryDelayMs_;
+    TimerId retryTimer_;
+    Timestamp connectStart_;
+
+    std::atomic<int64_t> attempts_;
+    std::atomic<int64_t> established_;
+    std::atomic<int64_t> failures_;
+    std::atomic<int64_t> selfConnects_;
+    std::atomic<int64_t> retries_;
+    std::atomic<int64_t> lastConnectMicros_;
+    std::atomic<int64_t> totalConnectMicros_;
+};
+
+#endif
@@ -3,15 +3,42 @@
 #include <stdlib.h>
 
 #include "EPollPoller.h"
+#include "IoUringPoller.h"
+#include "Logger.h"
 
 Poller* Poller::newDefaultPoller(EventLoop *loop)
 {
-    if (::getenv("MUDUO_USE_POLL"))
+    if (::getenv("MUDUO_USE_IOURING"))
     {
-        return nullptr;     // 生成poll的实例
+        return newPoller(loop, kIoUringPoller);     // 生成io_uring的实例
+    }
+    else if (::getenv("MUDUO_USE_POLL"))
+    {
+        // 没有实现poll(2)的Poller, 返回空指针会让EventLoop解引用空的poller_
+        LOG_ERROR("poll(2) poller is not implemented, use epoll \n");
+        return new EPollPoller(loop);
     }
     else
     {
         return new EPollPoller(loop);     // 生成epoll的实例
     }
-}
\ No newline at end of file
+}
+
+Poller* Poller::newPoller(EventLoop *loop, int type)
+{
+    if (type == kDefaultPoller)
+    {
+        return newDefaultPoller(loop);
+    }
+    if (type == kIoUringPoller)
+    {
+        IoUringPoller *poller = new IoUringPoller(loop);
+        if (poller->valid())
+        {
+            return poller;
+        }
+        delete poller;
+        LOG_ERROR("io_uring is not available, fall back to epoll \n");
+    }
+    return new EPollPoller(loop);
+}
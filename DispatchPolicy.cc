@@ -0,0 +1,140 @@
+#include "DispatchPolicy.h"
+
+#include "EventLoop.h"
+#include "InetAddress.h"
+#include "Logger.h"
+
+namespace
+{
+
+class RoundRobinPolicy : public DispatchPolicy
+{
+public:
+    RoundRobinPolicy()
+        : next_(0)
+    {}
+
+    EventLoop* select(const std::vector<EventLoop*> &loops, const InetAddress*) override
+    {
+        if (next_ >= loops.size())
+        {
+            next_ = 0;
+        }
+        return loops[next_++];
+    }
+
+private:
+    size_t next_;
+};
+
+/*
+ * 负载相同的loop之间从轮换的起点开始比较, 避免总是选中下标最小的那个
+ * 新连接在TcpServer::newConnection中构造时就计入了目标loop, 连续到来的连接不会都挤到同一个loop上
+*/
+class LeastConnectionsPolicy : public DispatchPolicy
+{
+public:
+    LeastConnectionsPolicy()
+        : start_(0)
+    {}
+
+    EventLoop* select(const std::vector<EventLoop*> &loops, const InetAddress*) override
+    {
+        const size_t n = loops.size();
+        start_ = (start_ + 1) % n;
+        EventLoop *best = loops[start_];
+        int bestConns = best->activeConnections();
+        for (size_t i = 1; i < n && bestConns > 0; ++i)
+        {
+            EventLoop *loop = loops[(start_ + i) % n];
+            int conns = loop->activeConnections();
+            if (conns < bestConns)
+            {
+                best = loop;
+                bestConns = conns;
+            }
+        }
+        return best;
+    }
+
+private:
+    size_t start_;
+};
+
+/*
+ * 繁忙占比每kLoadWindowMs才更新一次, 只按它选择时一个窗口内的新连接会全部落到同一个loop上
+ * 所以繁忙占比按kBusyBucket分档, 同一档内的loop再比较立即更新的连接数
+*/
+class LeastBusyPolicy : public DispatchPolicy
+{
+public:
+    LeastBusyPolicy()
+        : start_(0)
+    {}
+
+    EventLoop* select(const std::vector<EventLoop*> &loops, const InetAddress*) override
+    {
+        const size_t n = loops.size();
+        start_ = (start_ + 1) % n;
+        EventLoop *best = nullptr;
+        int bestBusy = 0;
+        int bestConns = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            EventLoop *loop = loops[(start_ + i) % n];
+            int busy = loop->recentBusyPermille() / kBusyBucket;
+            int conns = loop->activeConnections();
+            if (best == nullptr || busy < bestBusy || (busy == bestBusy && conns < bestConns))
+            {
+                best = loop;
+                bestBusy = busy;
+                bestConns = conns;
+            }
+        }
+        return best;
+    }
+
+private:
+    static const int kBusyBucket = 50;      // 千分比, 即繁忙占比相差5%以内视为相同
+
+    size_t start_;
+};
+
+class PeerHashPolicy : public DispatchPolicy
+{
+public:
+    EventLoop* select(const std::vector<EventLoop*> &loops, const InetAddress *peerAddr) override
+    {
+        if (peerAddr == nullptr)
+        {
+            return roundRobin_.select(loops, peerAddr);
+        }
+        // 只用ip不用端口, 同一个客户端的多个连接落在同一个loop上; 乘法哈希打散连续的地址
+        uint32_t ip = ntohl(peerAddr->getSockAddr()->sin_addr.s_addr);
+        uint32_t h = ip * 2654435761u;
+        return loops[(static_cast<uint64_t>(h) * loops.size()) >> 32];
+    }
+
+private:
+    RoundRobinPolicy roundRobin_;
+};
+
+}
+
+std::unique_ptr<DispatchPolicy> DispatchPolicy::newPolicy(int type)
+{
+    switch (type)
+    {
+    case kRoundRobin:
+        return std::unique_ptr<DispatchPolicy>(new RoundRobinPolicy);
+    case kLeastConnections:
+        return std::unique_ptr<DispatchPolicy>(new LeastConnectionsPolicy);
+    case kLeastBusy:
+        return std::unique_ptr<DispatchPolicy>(new LeastBusyPolicy);
+    case kPeerHash:
+        return std::unique_ptr<DispatchPolicy>(new PeerHashPolicy);
+    default:
+        LOG_ERROR("DispatchPolicy::newPolicy unknown policy type %d, use round robin \n", type);
+        return std::unique_ptr<DispatchPolicy>(new RoundRobinPolicy);
+    }
+}
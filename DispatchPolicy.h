@@ -0,0 +1,36 @@
+#ifndef _DISPATCHPOLICY_H_
+#define _DISPATCHPOLICY_H_
+
+#include <memory>
+#include <vector>
+
+#include "noncopyable.h"
+
+class EventLoop;
+class InetAddress;
+
+/*
+ * EventLoopThreadPool为新连接选择subloop的策略
+ * select只在baseLoop线程中调用, 实现可以有不加锁的内部状态
+ * 负载类策略读取的是loop自己维护的原子计数(EventLoop::activeConnections/recentBusyPermille), 不需要和subloop同步
+*/
+class DispatchPolicy : noncopyable
+{
+public:
+    enum PolicyType
+    {
+        kRoundRobin,            // 轮询
+        kLeastConnections,      // 当前连接数最少的loop, 适合长连接负载不均的场景
+        kLeastBusy,             // 最近繁忙时间占比最低的loop, 相近时再比较连接数
+        kPeerHash,              // 按对端ip哈希, 同一个客户端的连接总是落在同一个loop上(缓存/会话亲和)
+    };
+
+    static std::unique_ptr<DispatchPolicy> newPolicy(int type);
+
+    virtual ~DispatchPolicy() = default;
+
+    // loops非空; peerAddr是新连接的对端地址, 不是为某个连接选择时为nullptr
+    virtual EventLoop* select(const std::vector<EventLoop*> &loops, const InetAddress *peerAddr) = 0;
+};
+
+#endif
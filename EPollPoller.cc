@@ -33,7 +33,7 @@ EPollPoller::~EPollPoller()
 Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 {
     // 由于频繁调用epoll, 实际上应该用LOG_DEBUG输出日志更为合理, 当遇到并发场景 关闭DEBUG日志提升效率
-    LOG_DEBUG("func%s => fd total count:%d\n", __FUNCTION__, channels_.size());
+    LOG_DEBUG("func%s => fd total count:%zu\n", __FUNCTION__, channels_.size());
     //LOG_INFO("func%s => fd total count:%lu\n", __FUNCTION__ ,channels_.size());
     
     int numEvents = ::epoll_wait(epollfd_, &*events_.begin(), static_cast<int>(events_.size()), timeoutMs);
@@ -42,8 +42,7 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 
     if (numEvents > 0)
     {
-        // LOG_DEBUG("%d events happened \n", numEvents);
-        LOG_INFO("%d events happened \n", numEvents);
+        LOG_DEBUG("%d events happened \n", numEvents);
         fillActiveChannels(numEvents, activeChannels);
         if (numEvents == events_.size())    // 扩容操作
         {
@@ -76,7 +75,7 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 void EPollPoller::updateChannel(Channel *channel)
 {
     const int index = channel->index();
-    LOG_INFO("func=%s => fd=%d events=%d index=%d \n", __FUNCTION__, channel->fd(), channel->events(), index);
+    LOG_DEBUG("func=%s => fd=%d events=%d index=%d \n", __FUNCTION__, channel->fd(), channel->events(), index);
     if (index == kNew || index == kDeleted)
     {
         if (index == kNew)
@@ -112,10 +111,11 @@ void EPollPoller::removeChannel(Channel *channel)
     int fd = channel->fd();
     channels_.erase(fd);
 
-    LOG_INFO("func=%s => fd=%d \n", __FUNCTION__, fd);
+    LOG_DEBUG("func=%s => fd=%d \n", __FUNCTION__, fd);
 
     int index = channel->index();
-    if (index == kDeleted)
+    // 只有仍在epoll中注册的channel才需要EPOLL_CTL_DEL, kDeleted状态已经从epoll中删除过了
+    if (index == kAdded)
     {
         update(EPOLL_CTL_DEL, channel);
     }
@@ -143,7 +143,7 @@ void EPollPoller::update(int operation, Channel *channel)
 
     int fd = channel->fd();
 
-    event.events = channel->events();
+    event.events = channel->registeredEvents();
     event.data.fd = fd;
     event.data.ptr = channel;
 
@@ -5,16 +5,25 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <memory>
+#include <algorithm>
 
 #include "Logger.h"
 #include "Poller.h"
+#include "IoUringPoller.h"
 #include "Channel.h"
+#include "TimerQueue.h"
+#include "TimingWheel.h"
+#include "Slab.h"
 
 // 防止一个线程创建多个EventLoop  __thread <==> thread_local
 __thread EventLoop *t_loopInThisThread = nullptr;
 
 // 定义默认的Poller IO复用接口的超时时间
 const int kPollTimeMs = 10000;  // 10000毫秒 = 10 秒钟
+// 负载统计的窗口长度
+const int kLoadWindowMs = 100;
+// 共享读缓冲区的初始大小, 连接的读取量变大时会扩到Buffer::extraBufferSize()并一直保留
+const size_t kReadBufferSize = 64 * 1024 - Buffer::kCheapPrepend;
                                 
 /*
  * 创建线程之后主线程和子线程谁先运行是不确定的
@@ -44,14 +53,26 @@ int createEventfd()
     return evtfd;
 }
 
-EventLoop::EventLoop()
+EventLoop::EventLoop(int pollerType)
     : looping_(false)
     , quit_(false)
     , callingPendingFunctors_(false)
     , threadId_(CurrentThread::tid())
-    , poller_(Poller::newDefaultPoller(this))
+    , poller_(Poller::newPoller(this, pollerType))
+    , ioUringPoller_(dynamic_cast<IoUringPoller*>(poller_.get()))
+    , timerQueue_(new TimerQueue(this))
     , wakeupFd_(createEventfd())
     , wakeupChannel_(new Channel(this, wakeupFd_))
+    , wakeupPending_(false)
+    , wakeupsWritten_(0)
+    , wakeupsElided_(0)
+    , readBuffer_(kReadBufferSize)
+    , slab_(std::make_shared<Slab>())
+    , activeConnections_(0)
+    , busyPermille_(0)
+    , loadUpdated_(Timestamp::now().microSecondsSinceEpoch())
+    , loadWindowStart_(Timestamp::now())
+    , busyInWindow_(0)
 {
     LOG_DEBUG("EventLoop created %p in thread %d \n", this, threadId_);
     if (t_loopInThisThread)
@@ -63,6 +84,8 @@ EventLoop::EventLoop()
         t_loopInThisThread = this;
     }
 
+    readBuffer_.setMaxRetainSize(Buffer::extraBufferSize());
+
     // 设置wakeupfd的事件类型, 以及发生事件后的回调操作
     wakeupChannel_->setReadCallback(std::bind(&EventLoop::handleRead, this));
     // 每一个EventLoop都将监听wakeupchannel的EPOllIN读事件了
@@ -71,6 +94,7 @@ EventLoop::EventLoop()
 
 EventLoop::~EventLoop()
 {
+    timingWheel_.reset();
     // 给Channel移除所有感兴趣的事件
     wakeupChannel_->disableAll();       
     // 把Channel从EventLoop上删除掉
@@ -91,6 +115,8 @@ void EventLoop::loop()
         activeChannels_.clear();
         // 监听两类fd  一种是clientfd, 一种是wakeupfd
         pollReturnTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        // loop已经醒了, 处理完这一轮事件后一定会执行doPendingFunctors, 期间其他线程queueInLoop不需要再写eventfd
+        wakeupPending_.store(true);
         for (Channel *channel : activeChannels_)
         {
             // Poller监听哪些channel发生事件了, 然后上报给EventLoop, 通知channel处理相应的事件
@@ -103,12 +129,43 @@ void EventLoop::loop()
          * mainLoop 事先注册一个回调cb (需要subloop执行)  wakeup  subLoop后, 执行下面的方法, 执行之前mainLoop注册的doPendingFunctors
          */
         doPendingFunctors();
+        updateLoad();
     }
 
     LOG_INFO("EventLoop %p stop looping\n", this);
     looping_ = false;
 }
 
+void EventLoop::updateLoad()
+{
+    const int64_t now = Timestamp::now().microSecondsSinceEpoch();
+    busyInWindow_ += now - pollReturnTime_.microSecondsSinceEpoch();
+    const int64_t elapsed = now - loadWindowStart_.microSecondsSinceEpoch();
+    if (elapsed >= kLoadWindowMs * 1000)
+    {
+        // 和上一个窗口取平均, 平滑掉单个窗口的波动
+        int permille = static_cast<int>(std::min<int64_t>(busyInWindow_ * 1000 / elapsed, 1000));
+        busyPermille_.store((busyPermille_.load(std::memory_order_relaxed) + permille) / 2,
+                            std::memory_order_relaxed);
+        loadUpdated_.store(now, std::memory_order_relaxed);
+        loadWindowStart_ = Timestamp(now);
+        busyInWindow_ = 0;
+    }
+}
+
+int EventLoop::recentBusyPermille() const
+{
+    int permille = busyPermille_.load(std::memory_order_relaxed);
+    // loop阻塞在poll中时不会更新统计, 超过一个窗口没有更新说明这段时间是空闲的, 之后每过一个窗口减半
+    const int64_t idle = Timestamp::now().microSecondsSinceEpoch() - loadUpdated_.load(std::memory_order_relaxed);
+    const int64_t windows = idle / (kLoadWindowMs * 1000);
+    if (windows > 1)
+    {
+        permille >>= std::min<int64_t>(windows - 1, 16);
+    }
+    return permille;
+}
+
 /*
  * 退出事件循环
  * 1. loop在自己的线程中调用quit, 说明当前线程已经执行完毕了loop()函数的poller_->poll并退出
@@ -153,10 +210,7 @@ void EventLoop::runInLoop(Functor cb)
 // 把cb放入队列中, 唤醒loop所在的线程, 执行cb
 void EventLoop::queueInLoop(Functor cb)
 {
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb);
-    }
+    pendingFunctors_.push(std::move(cb));
 
     /*
      * 唤醒相应的, 执行上面回调操作的loop线程
@@ -174,6 +228,14 @@ void EventLoop::queueInLoop(Functor cb)
 // 用来唤醒loop所在的线程  向wakeupfd写一个数据 wakeupChannel就发生读事件, 当前loop线程就会被唤醒
 void EventLoop::wakeup()
 {
+    // 已经有未处理的唤醒, loop在阻塞之前一定会检查任务队列, 省掉这次write系统调用
+    if (wakeupPending_.exchange(true))
+    {
+        wakeupsElided_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    wakeupsWritten_.fetch_add(1, std::memory_order_relaxed);
     uint64_t one = 1;
     ssize_t n = write(wakeupFd_, &one, sizeof one);
     if (n != sizeof one)
@@ -182,6 +244,37 @@ void EventLoop::wakeup()
     }
 }
 
+TimerId EventLoop::runAt(Timestamp time, TimerCallback cb)
+{
+    return timerQueue_->addTimer(std::move(cb), time, 0.0);
+}
+
+TimerId EventLoop::runAfter(double delay, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::now(), delay));
+    return runAt(time, std::move(cb));
+}
+
+TimerId EventLoop::runEvery(double interval, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::now(), interval));
+    return timerQueue_->addTimer(std::move(cb), time, interval);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
+}
+
+TimingWheel* EventLoop::timingWheel()
+{
+    if (!timingWheel_)
+    {
+        timingWheel_.reset(new TimingWheel(this));
+    }
+    return timingWheel_.get();
+}
+
 // EventLoop的方法 => Poller的方法
 void EventLoop::updateChannel(Channel *channel)
 {
@@ -211,20 +304,19 @@ void EventLoop::handleRead()
 // 执行回调
 void EventLoop::doPendingFunctors()
 {
-    std::vector<Functor> functors;
     callingPendingFunctors_ = true;
 
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        // 交换的方式减少了锁的临界区范围, 提升效率, 同时避免了死锁, 如果执行functor()在临界区内, 且functor()中调用queueInLoop()就会产生死锁
-        functors.swap(pendingFunctors_);
-    }
+    /*
+     * 必须在取任务之前清除唤醒标记: 清除之后入队的任务, 生产者会重新写eventfd
+     * 清除之前入队的任务, 生产者的push对这里的exchange可见, 一定能在下面的drain中取到
+    */
+    wakeupPending_.exchange(false);
 
-    for (auto functor : functors)
-    {
+    // 批量取出当前已经入队的回调并执行, 执行过程中新加入的回调留到下一轮, 和原来交换vector的语义一致
+    pendingFunctors_.drain([](Functor &functor) {
         // 执行当前loop需要执行的回调操作
         functor();
-    }
+    });
 
     callingPendingFunctors_ = false;
 }
\ No newline at end of file
@@ -5,16 +5,23 @@
 #include <vector>
 #include <atomic>
 #include <memory>
-#include <mutex>
 
 
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "Callbacks.h"
+#include "TimerId.h"
+#include "MpscQueue.h"
+#include "Buffer.h"
 
 
 class Channel;
 class Poller;
+class TimerQueue;
+class TimingWheel;
+class IoUringPoller;
+class Slab;
 
 // 事件循环类   主要包含了两个大模块 Channel  Poller(epoll抽象)
 class EventLoop : noncopyable
@@ -22,7 +29,8 @@ class EventLoop : noncopyable
 public:
     using Functor = std::function<void()>;
 
-    EventLoop();
+    // pollerType见Poller::PollerType, 默认由环境变量决定
+    explicit EventLoop(int pollerType = 0);
     ~EventLoop();
 
     // 开启事件循环
@@ -37,9 +45,46 @@ public:
     // 把上层注册的回调函数cb放入队列中, 唤醒loop所在的线程, 执行c
     void queueInLoop(Functor cb);
 
-    // 用来唤醒loop所在的线程
+    // 用来唤醒loop所在的线程, loop已经醒着或者已经有未处理的唤醒时不再写eventfd
     void wakeup();
 
+    // 唤醒统计: 实际写eventfd的次数, 以及因为已有未处理的唤醒而省掉的次数
+    uint64_t wakeupsWritten() const { return wakeupsWritten_.load(std::memory_order_relaxed); }
+    uint64_t wakeupsElided() const { return wakeupsElided_.load(std::memory_order_relaxed); }
+
+    // 定时器, 回调在loop线程中执行, 这些接口都是线程安全的
+    // 在time时刻执行cb
+    TimerId runAt(Timestamp time, TimerCallback cb);
+    // delay秒之后执行cb
+    TimerId runAfter(double delay, TimerCallback cb);
+    // 每隔interval秒执行一次cb
+    TimerId runEvery(double interval, TimerCallback cb);
+    // 取消定时器
+    void cancel(TimerId timerId);
+
+    // 用于连接超时管理的时间轮, 第一次使用时创建, 只能在loop线程中调用
+    TimingWheel* timingWheel();
+
+    // 使用io_uring作为IO复用时返回对应的poller, 否则返回nullptr
+    IoUringPoller* ioUringPoller() const { return ioUringPoller_; }
+
+    // loop线程中所有连接共享的读缓冲区, 只能在loop线程中使用, 用完之后必须清空
+    Buffer* readBuffer() { return &readBuffer_; }
+
+    // 属于这个loop的连接对象从这里分配, 可以在任意线程调用
+    const std::shared_ptr<Slab>& slab() const { return slab_; }
+
+    /*
+     * 负载统计, 由loop自己维护, 供EventLoopThreadPool的分配策略在任意线程无锁读取
+     * activeConnections: 属于这个loop、已经创建还没有connectDestroyed的连接数
+     * recentBusyPermille: 最近一段时间loop处理事件(从poll返回到下一次poll)所占时间的千分比
+    */
+    int activeConnections() const { return activeConnections_.load(std::memory_order_relaxed); }
+    int recentBusyPermille() const;
+    // TcpConnection构造和connectDestroyed时调用
+    void connectionCreated() { activeConnections_.fetch_add(1, std::memory_order_relaxed); }
+    void connectionDestroyed() { activeConnections_.fetch_sub(1, std::memory_order_relaxed); }
+
     // EventLoop的方法 => Poller的方法
     void updateChannel(Channel *channel);
     void removeChannel(Channel *channel);
@@ -52,6 +97,8 @@ private:
     void handleRead();
     // 执行回调
     void doPendingFunctors();
+    // 累计这一轮的处理时间, 每kLoadWindowMs更新一次recentBusyPermille
+    void updateLoad();
 
     using ChannelList = std::vector<Channel*>;
 
@@ -62,15 +109,33 @@ private:
                                                     
     Timestamp pollReturnTime_;                      // poller返回发生时间的channel的时间点
     std::unique_ptr<Poller> poller_;                
+    IoUringPoller *ioUringPoller_;
+    std::unique_ptr<TimerQueue> timerQueue_;        // 定时器队列, 依赖poller_, 必须在poller_之后构造
+    std::unique_ptr<TimingWheel> timingWheel_;      // 时间轮, 由timerQueue_驱动, 必须在timerQueue_之前析构
     
     int wakeupFd_;                                  // 主要作用: 当mainLoop获取一个新用户的channel，通过轮询算法选择subloop, 通过该成员唤醒subloop处理事件
     std::unique_ptr<Channel> wakeupChannel_;        
+    /*
+     * true表示loop不会在检查任务队列之前阻塞: 要么已经有人写了eventfd, 要么loop刚从poll返回还没执行doPendingFunctors
+     * 生产者只有把它从false改成true时才需要写eventfd, loop在取任务队列之前把它清为false
+    */
+    std::atomic_bool wakeupPending_;
+    std::atomic<uint64_t> wakeupsWritten_;
+    std::atomic<uint64_t> wakeupsElided_;
 
     ChannelList activeChannels_;                    // 返回Poller检测到当前有事件发生的所有Channel列表
 
     std::atomic_bool callingPendingFunctors_;       // 标识当前loop是否有需要执行的回调操作
-    std::vector<Functor> pendingFunctors_;          // 存储loop需要执行的所有回调操作
-    std::mutex mutex_;                              // 互斥锁, 用来保护上面vector容器的线程安全操作
+    MpscQueue<Functor> pendingFunctors_;            // 存储loop需要执行的所有回调操作, 无锁多生产者单消费者队列
+
+    Buffer readBuffer_;                             // 连接没有残留数据时先读到这里, 只有不完整的消息才拷贝进连接自己的缓冲区
+    std::shared_ptr<Slab> slab_;                    // 连接对象的内存池, 由连接共同持有, 可能比loop活得更久
+
+    std::atomic_int activeConnections_;
+    std::atomic_int busyPermille_;                  // 最近的窗口平滑之后的繁忙千分比
+    std::atomic<int64_t> loadUpdated_;              // busyPermille_上一次更新的时间(微秒)
+    Timestamp loadWindowStart_;                     // 以下两个只在loop线程中访问
+    int64_t busyInWindow_;                          // 当前窗口中累计的处理时间(微秒)
 };
 
 #endif 
\ No newline at end of file
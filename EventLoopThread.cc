@@ -3,13 +3,14 @@
 #include "EventLoop.h"
 
 EventLoopThread::EventLoopThread(const ThreadInitCallback &cb,
-    const std::string &name)
+    const std::string &name, int pollerType)
     : loop_(nullptr)
     , exiting_(false)
     , thread_(std::bind(&EventLoopThread::threadFunc, this), name)
     , mutex_()
     , cond_()
     , callback_(cb)
+    , pollerType_(pollerType)
 {
 }
 
@@ -44,7 +45,7 @@ EventLoop* EventLoopThread::startLoop()
 // 下面这个方法, 是在单独的新线程里面运行的
 void EventLoopThread::threadFunc()
 {
-    EventLoop loop;     // 创建一个独立的Eventloop, 和上面的线程是一一对应的, one loop per thread
+    EventLoop loop(pollerType_);     // 创建一个独立的Eventloop, 和上面的线程是一一对应的, one loop per thread
 
     if (callback_)
     {
@@ -18,7 +18,8 @@ public:
     using ThreadInitCallback = std::function<void(EventLoop*)>;
 
     EventLoopThread(const ThreadInitCallback &cb = ThreadInitCallback(),
-        const std::string &name = std::string());
+        const std::string &name = std::string(),
+        int pollerType = 0);
     ~EventLoopThread();
 
     EventLoop* startLoop();
@@ -31,6 +32,7 @@ private:
     std::mutex mutex_;
     std::condition_variable cond_;
     ThreadInitCallback callback_;
+    int pollerType_;
 };
 
 #endif
\ No newline at end of file
@@ -9,7 +9,8 @@ EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string
     , name_(nameArg)
     , started_(false)
     , numThreads_(0)
-    , next_(0)
+    , pollerType_(0)
+    , policy_(DispatchPolicy::newPolicy(DispatchPolicy::kRoundRobin))
 {
 }
 
@@ -25,7 +26,7 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
     {
         char buf[name_.size() + 32];
         snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i);
-        EventLoopThread *t = new EventLoopThread(cb, buf);
+        EventLoopThread *t = new EventLoopThread(cb, buf, pollerType_);
         threads_.push_back(std::unique_ptr<EventLoopThread>(t));
         loops_.push_back(t->startLoop());       // 底层创建线程, 绑定要给新的EventLoop, 并返回该loop地址
     }
@@ -37,21 +38,23 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
     }
 }
 
-// 如果工作在多线程中, baseLoop默认以轮询的方式分配channel给subLoop
+// 如果工作在多线程中, baseLoop按分配策略选择subLoop, 没有subLoop时就是baseLoop自己
 EventLoop* EventLoopThreadPool::getNextLoop()
 {
-    EventLoop *loop = baseLoop_;
+    if (loops_.empty())
+    {
+        return baseLoop_;
+    }
+    return policy_->select(loops_, nullptr);
+}
 
-    if (!loops_.empty())        // 通过轮询获取下一个处理事件的loop
+EventLoop* EventLoopThreadPool::getNextLoop(const InetAddress &peerAddr)
+{
+    if (loops_.empty())
     {
-        loop = loops_[next_];
-        ++next_;
-        if (next_ >= loops_.size())
-        {
-            next_ = 0;
-        }
+        return baseLoop_;
     }
-    return loop;
+    return policy_->select(loops_, &peerAddr);
 }
 
 std::vector<EventLoop*> EventLoopThreadPool::getAllLoops()
@@ -7,9 +7,11 @@
 #include <memory>
 
 #include "noncopyable.h"
+#include "DispatchPolicy.h"
 
 class EventLoop;
 class EventLoopThread;
+class InetAddress;
 
 class EventLoopThreadPool : noncopyable
 {
@@ -20,11 +22,19 @@ public:
     ~EventLoopThreadPool();
 
     void setThreadNum(int numThreads) { numThreads_ = numThreads; }
+    // subLoop使用的IO复用实现, 见Poller::PollerType
+    void setPollerType(int pollerType) { pollerType_ = pollerType; }
 
     void start(const ThreadInitCallback &cb = ThreadInitCallback());
 
-    // 如果工作在多线程中, baseLoop默认以轮询的方式分配channel给subLoop
+    // 为新连接选择subLoop的策略, 见DispatchPolicy::PolicyType, 默认轮询; 只能在baseLoop线程中调用
+    void setDispatchPolicy(int type) { policy_ = DispatchPolicy::newPolicy(type); }
+    void setDispatchPolicy(std::unique_ptr<DispatchPolicy> policy) { policy_ = std::move(policy); }
+
+    // 如果工作在多线程中, baseLoop按分配策略选择subLoop, 只能在baseLoop线程中调用
     EventLoop* getNextLoop();
+    // 为对端是peerAddr的新连接选择subLoop
+    EventLoop* getNextLoop(const InetAddress &peerAddr);
 
     std::vector<EventLoop*> getAllLoops();
 
@@ -36,7 +46,8 @@ private:
     std::string name_;
     bool started_;
     int numThreads_;
-    int next_;
+    int pollerType_;
+    std::unique_ptr<DispatchPolicy> policy_;
     std::vector<std::unique_ptr<EventLoopThread>> threads_;
     std::vector<EventLoop*> loops_;
 };
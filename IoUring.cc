@@ -0,0 +1,265 @@
+#include "IoUring.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+
+#include "Logger.h"
+
+IoUring::IoUring(unsigned entries)
+    : ringFd_(-1)
+    , features_(0)
+    , sqRing_(MAP_FAILED)
+    , sqRingSize_(0)
+    , cqRing_(MAP_FAILED)
+    , cqRingSize_(0)
+    , sqes_(static_cast<io_uring_sqe*>(MAP_FAILED))
+    , sqesSize_(0)
+    , sqeTail_(0)
+{
+    memset(supportedOps_, 0, sizeof supportedOps_);
+
+    io_uring_params params;
+    memset(&params, 0, sizeof params);
+    // 完成队列设置得比提交队列大, 一轮事件循环中的完成事件尽量不溢出
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = entries * 4;
+
+    int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0)
+    {
+        LOG_ERROR("io_uring_setup error:%d \n", errno);
+        return;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        sqRingSize_ = cqRingSize_ = sqRingSize_ > cqRingSize_ ? sqRingSize_ : cqRingSize_;
+    }
+
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring mmap sq ring error:%d \n", errno);
+        ::close(fd);
+        return;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        cqRing_ = sqRing_;
+    }
+    else
+    {
+        cqRing_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED)
+        {
+            LOG_ERROR("io_uring mmap cq ring error:%d \n", errno);
+            ::munmap(sqRing_, sqRingSize_);
+            ::close(fd);
+            return;
+        }
+    }
+
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring mmap sqes error:%d \n", errno);
+        if (cqRing_ != sqRing_)
+        {
+            ::munmap(cqRing_, cqRingSize_);
+        }
+        ::munmap(sqRing_, sqRingSize_);
+        ::close(fd);
+        return;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char *sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqEntries_ = params.sq_entries;
+    sqeTail_ = *sqTail_;
+    // 提交队列的下标数组和sqes一一对应, 之后就不用再维护了
+    unsigned *array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < sqEntries_; ++i)
+    {
+        array[i] = i;
+    }
+
+    char *cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    ringFd_ = fd;
+    features_ = params.features;
+
+    // 查询内核支持的操作码
+    size_t probeSize = sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op);
+    char probeBuf[sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op)];
+    memset(probeBuf, 0, probeSize);
+    io_uring_probe *probe = reinterpret_cast<io_uring_probe*>(probeBuf);
+    if (::syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0)
+    {
+        for (int i = 0; i < probe->ops_len && i < IORING_OP_LAST; ++i)
+        {
+            if (probe->ops[i].flags & IO_URING_OP_SUPPORTED)
+            {
+                supportedOps_[i] = 1;
+            }
+        }
+    }
+}
+
+IoUring::~IoUring()
+{
+    if (ringFd_ < 0)
+    {
+        return;
+    }
+    ::munmap(sqes_, sqesSize_);
+    if (cqRing_ != sqRing_)
+    {
+        ::munmap(cqRing_, cqRingSize_);
+    }
+    ::munmap(sqRing_, sqRingSize_);
+    ::close(ringFd_);
+}
+
+bool IoUring::opSupported(int op) const
+{
+    return op >= 0 && op < IORING_OP_LAST && supportedOps_[op];
+}
+
+io_uring_sqe* IoUring::getSqe()
+{
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqeTail_ - head >= sqEntries_)
+    {
+        // 提交队列满了, 先交给内核
+        submit();
+        head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        if (sqeTail_ - head >= sqEntries_)
+        {
+            return nullptr;
+        }
+    }
+
+    io_uring_sqe *sqe = &sqes_[sqeTail_ & sqMask_];
+    ++sqeTail_;
+    memset(sqe, 0, sizeof *sqe);
+    return sqe;
+}
+
+unsigned IoUring::pendingSqes() const
+{
+    return sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+}
+
+int IoUring::submit()
+{
+    unsigned toSubmit = pendingSqes();
+    if (toSubmit == 0)
+    {
+        return 0;
+    }
+    return enter(toSubmit, 0, 0, nullptr, 0);
+}
+
+int IoUring::submitAndWait(int timeoutMs)
+{
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    memset(&arg, 0, sizeof arg);
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeoutMs >= 0)
+    {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000 * 1000;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+    return enter(pendingSqes(), 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof arg);
+}
+
+int IoUring::enter(unsigned toSubmit, unsigned minComplete, unsigned flags, const void *arg, size_t argSize)
+{
+    // 把本地填好的提交项发布给内核
+    __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+    int ret = static_cast<int>(::syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete, flags, arg, argSize));
+    return ret < 0 ? -errno : ret;
+}
+
+IoUringBufferRing::IoUringBufferRing(IoUring *ring, int groupId, unsigned count, unsigned bufferSize)
+    : ring_(ring)
+    , groupId_(groupId)
+    , count_(count)
+    , bufferSize_(bufferSize)
+    , bufRing_(nullptr)
+    , bufRingSize_(count * sizeof(io_uring_buf))
+    , buffers_(nullptr)
+    , tail_(0)
+    , registered_(false)
+{
+    // count必须是2的幂
+    void *mem = ::mmap(nullptr, bufRingSize_, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring buffer ring mmap error:%d \n", errno);
+        return;
+    }
+    bufRing_ = static_cast<io_uring_buf_ring*>(mem);
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof reg);
+    reg.ring_addr = reinterpret_cast<uint64_t>(bufRing_);
+    reg.ring_entries = count_;
+    reg.bgid = static_cast<uint16_t>(groupId_);
+    if (::syscall(__NR_io_uring_register, ring_->fd(), IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        LOG_ERROR("io_uring register buffer ring error:%d \n", errno);
+        return;
+    }
+    registered_ = true;
+
+    buffers_ = new char[static_cast<size_t>(count_) * bufferSize_];
+    for (unsigned i = 0; i < count_; ++i)
+    {
+        recycle(i);
+    }
+}
+
+IoUringBufferRing::~IoUringBufferRing()
+{
+    if (registered_)
+    {
+        io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof reg);
+        reg.bgid = static_cast<uint16_t>(groupId_);
+        ::syscall(__NR_io_uring_register, ring_->fd(), IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    }
+    if (bufRing_ != nullptr)
+    {
+        ::munmap(bufRing_, bufRingSize_);
+    }
+    delete[] buffers_;
+}
+
+void IoUringBufferRing::recycle(int bid)
+{
+    // C++中头文件里的柔性数组成员bufs偏移不对, 直接把环当作io_uring_buf数组使用, tail和第一项的resv重叠
+    io_uring_buf *buf = reinterpret_cast<io_uring_buf*>(bufRing_) + (tail_ & (count_ - 1));
+    buf->addr = reinterpret_cast<uint64_t>(buffer(bid));
+    buf->len = bufferSize_;
+    buf->bid = static_cast<uint16_t>(bid);
+    ++tail_;
+    // 发布给内核
+    __atomic_store_n(&bufRing_->tail, tail_, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,119 @@
+#ifndef _IOURING_H_
+#define _IOURING_H_
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+
+#include "noncopyable.h"
+
+/*
+ * 不依赖liburing, 直接通过系统调用使用io_uring
+ * 只在所属EventLoop的线程中使用, 不加锁
+ * 
+ * getSqe()取得一个清零的提交项, 填好之后不需要单独提交, 下一次submit/submitAndWait会把所有积攒的提交项一次性交给内核
+ * forEachCqe()依次处理完成队列中的完成事件
+*/
+class IoUring : noncopyable
+{
+public:
+    explicit IoUring(unsigned entries);
+    ~IoUring();
+
+    // 创建失败(内核不支持或者被禁用)时返回false
+    bool valid() const { return ringFd_ >= 0; }
+    unsigned features() const { return features_; }
+    int fd() const { return ringFd_; }
+    // 内核是否支持某个操作码
+    bool opSupported(int op) const;
+
+    // 获取一个提交项, 提交队列满时先把已有的提交项交给内核
+    io_uring_sqe* getSqe();
+    // 还没有交给内核的提交项个数
+    unsigned pendingSqes() const;
+
+    // 提交所有积攒的提交项, 不等待
+    int submit();
+    // 提交所有积攒的提交项, 并等待至少一个完成事件, timeoutMs < 0表示一直等待
+    int submitAndWait(int timeoutMs);
+
+    // 依次处理完成事件, 返回处理的个数
+    template <typename Func>
+    unsigned forEachCqe(Func func)
+    {
+        unsigned head = *cqHead_;
+        unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        while (head != tail)
+        {
+            const io_uring_cqe *cqe = &cqes_[head & cqMask_];
+            func(cqe);
+            ++head;
+            ++count;
+            // 让出完成队列的空间
+            __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+            if (head == tail)
+            {
+                tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+            }
+        }
+        return count;
+    }
+private:
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags, const void *arg, size_t argSize);
+
+    int ringFd_;
+    unsigned features_;
+
+    void *sqRing_;
+    size_t sqRingSize_;
+    void *cqRing_;
+    size_t cqRingSize_;
+    io_uring_sqe *sqes_;
+    size_t sqesSize_;
+
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    unsigned sqeTail_;          // 本地已经填好的提交项的尾部, 提交时写回sqTail_
+
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe *cqes_;
+
+    unsigned char supportedOps_[IORING_OP_LAST];
+};
+
+/*
+ * 提供给内核的接收缓冲区组(IORING_REGISTER_PBUF_RING)
+ * 带IOSQE_BUFFER_SELECT的recv在数据到达时才从组里取一块缓冲区, 没有数据的连接不占用接收内存
+ * 用户处理完数据之后要把缓冲区recycle回组里
+*/
+class IoUringBufferRing : noncopyable
+{
+public:
+    IoUringBufferRing(IoUring *ring, int groupId, unsigned count, unsigned bufferSize);
+    ~IoUringBufferRing();
+
+    bool valid() const { return registered_; }
+    int groupId() const { return groupId_; }
+    unsigned bufferSize() const { return bufferSize_; }
+
+    // 完成事件中的缓冲区id对应的数据
+    const char* buffer(int bid) const { return buffers_ + static_cast<size_t>(bid) * bufferSize_; }
+    // 把缓冲区还给内核
+    void recycle(int bid);
+private:
+    IoUring *ring_;
+    int groupId_;
+    unsigned count_;
+    unsigned bufferSize_;
+    io_uring_buf_ring *bufRing_;
+    size_t bufRingSize_;
+    char *buffers_;
+    unsigned short tail_;
+    bool registered_;
+};
+
+#endif
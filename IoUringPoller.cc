@@ -0,0 +1,348 @@
+#include "IoUringPoller.h"
+
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/epoll.h>
+
+#include "Logger.h"
+#include "Channel.h"
+
+// channel的状态和EPollPoller保持一致
+const int kNew = -1;
+const int kAdded = 1;
+const int kDeleted = 2;
+
+namespace
+{
+/*
+ * user_data: 最高位表示内部操作(POLL_REMOVE/ASYNC_CANCEL)的完成事件, 直接丢弃
+ * 次高位表示IoUringOp, 其余位是op的地址
+ * 否则是poll注册, 低32位是fd, 中间30位是注册的代数
+*/
+const uint64_t kInternalOp = 1ULL << 63;
+const uint64_t kCompletionOp = 1ULL << 62;
+const uint32_t kGenMask = 0x3fffffff;
+
+uint64_t makeUserData(int fd, uint32_t gen)
+{
+    return (static_cast<uint64_t>(gen & kGenMask) << 32) | static_cast<uint32_t>(fd);
+}
+}
+
+IoUringPoller::IoUringPoller(EventLoop *loop)
+    : Poller(loop)
+    , ring_(kRingEntries)
+    , round_(0)
+    , completionSupported_(-1)
+{
+}
+
+IoUringPoller::~IoUringPoller()
+{
+}
+
+bool IoUringPoller::valid() const
+{
+    // EXT_ARG(5.11)用于带超时的等待, multishot poll(5.13)没有单独的特性位, 用同一版本引入的RSRC_TAGS判断
+    return ring_.valid()
+        && (ring_.features() & IORING_FEAT_EXT_ARG)
+        && (ring_.features() & IORING_FEAT_RSRC_TAGS)
+        && ring_.opSupported(IORING_OP_POLL_ADD)
+        && ring_.opSupported(IORING_OP_POLL_REMOVE);
+}
+
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList *activeChannels)
+{
+    LOG_DEBUG("func%s => fd total count:%zu\n", __FUNCTION__, channels_.size());
+
+    // 上一轮返回的单次poll在这里统一重新注册, 和等待合并为一次系统调用
+    for (int fd : rearm_)
+    {
+        FdState &st = fds_[fd];
+        st.queued = false;
+        if (st.channel != nullptr && !st.armed && !st.channel->isNoneEvent())
+        {
+            arm(fd, st);
+        }
+    }
+    rearm_.clear();
+
+    int ret = ring_.submitAndWait(timeoutMs);
+    int savedErrno = -ret;
+    Timestamp now(Timestamp::now());
+
+    ++round_;
+    ring_.forEachCqe(std::bind(&IoUringPoller::handleCqe, this, std::placeholders::_1));
+    // 完成事件的回调可能会移除channel, 所以先于活跃channel的收集执行
+    runCompletions(now);
+
+    if (!activeFds_.empty())
+    {
+        LOG_DEBUG("%zu events happened \n", activeFds_.size());
+        for (int fd : activeFds_)
+        {
+            FdState &st = fds_[fd];
+            if (st.channel != nullptr)
+            {
+                st.channel->set_revents(st.revents);
+                activeChannels->push_back(st.channel);
+            }
+            st.revents = 0;
+        }
+        activeFds_.clear();
+    }
+    else if (ret < 0 && savedErrno != ETIME && savedErrno != EINTR)
+    {
+        errno = savedErrno;
+        LOG_ERROR("IoUringPoller::poll() err:%d \n", savedErrno);
+    }
+    return now;
+}
+
+void IoUringPoller::updateChannel(Channel *channel)
+{
+    const int index = channel->index();
+    const int fd = channel->fd();
+    LOG_DEBUG("func=%s => fd=%d events=%d index=%d \n", __FUNCTION__, fd, channel->events(), index);
+
+    FdState &st = state(fd);
+    if (index == kNew || index == kDeleted)
+    {
+        if (index == kNew)
+        {
+            channels_[fd] = channel;
+        }
+        channel->set_index(kAdded);
+        st.channel = channel;
+        queueArm(fd, st);
+    }
+    else
+    {
+        if (channel->isNoneEvent())
+        {
+            disarm(fd, st);
+            channel->set_index(kDeleted);
+        }
+        else if (!st.armed || st.mask != static_cast<uint32_t>(channel->registeredEvents()))
+        {
+            // 事件改变了, 旧的poll作废, 按新的事件重新注册
+            disarm(fd, st);
+            queueArm(fd, st);
+        }
+    }
+}
+
+void IoUringPoller::removeChannel(Channel *channel)
+{
+    int fd = channel->fd();
+    channels_.erase(fd);
+
+    LOG_DEBUG("func=%s => fd=%d \n", __FUNCTION__, fd);
+
+    FdState &st = state(fd);
+    disarm(fd, st);
+    st.channel = nullptr;
+    st.revents = 0;
+    channel->set_index(kNew);
+}
+
+IoUringPoller::FdState& IoUringPoller::state(int fd)
+{
+    const size_t n = static_cast<size_t>(fd) + 1;
+    if (n > fds_.size())
+    {
+        fds_.resize(n > fds_.size() * 2 ? n : fds_.size() * 2);
+    }
+    return fds_[fd];
+}
+
+void IoUringPoller::arm(int fd, FdState &st)
+{
+    io_uring_sqe *sqe = ring_.getSqe();
+    if (sqe == nullptr)
+    {
+        LOG_FATAL("io_uring submission queue full, fd=%d \n", fd);
+    }
+
+    Channel *channel = st.channel;
+    st.mask = channel->registeredEvents();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    if (channel->edgeTriggered())
+    {
+        // ET模式用multishot poll, EPOLLET由内核保留
+        sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->poll32_events = st.mask;
+    }
+    else
+    {
+        sqe->poll32_events = st.mask & ~EPOLLET;
+    }
+    sqe->user_data = makeUserData(fd, st.gen);
+    st.armed = true;
+}
+
+void IoUringPoller::disarm(int fd, FdState &st)
+{
+    if (st.armed)
+    {
+        io_uring_sqe *sqe = ring_.getSqe();
+        if (sqe == nullptr)
+        {
+            LOG_FATAL("io_uring submission queue full, fd=%d \n", fd);
+        }
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = makeUserData(fd, st.gen);
+        sqe->user_data = kInternalOp;
+        st.armed = false;
+    }
+    // 之后到达的旧代数完成事件一律丢弃
+    ++st.gen;
+}
+
+void IoUringPoller::queueArm(int fd, FdState &st)
+{
+    if (!st.queued)
+    {
+        st.queued = true;
+        rearm_.push_back(fd);
+    }
+}
+
+void IoUringPoller::handleCqe(const io_uring_cqe *cqe)
+{
+    if (cqe->user_data & kInternalOp)
+    {
+        return;
+    }
+    if (cqe->user_data & kCompletionOp)
+    {
+        Completion c = { reinterpret_cast<IoUringOp*>(cqe->user_data & ~kCompletionOp), cqe->res, cqe->flags };
+        completions_.push_back(c);
+        return;
+    }
+
+    int fd = static_cast<int>(cqe->user_data & 0xffffffff);
+    uint32_t gen = static_cast<uint32_t>(cqe->user_data >> 32);
+    if (static_cast<size_t>(fd) >= fds_.size())
+    {
+        return;
+    }
+    FdState &st = fds_[fd];
+    if (st.channel == nullptr || gen != (st.gen & kGenMask))
+    {
+        return;
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        // 单次poll已经返回, 或者multishot被内核终止, 都需要重新注册
+        st.armed = false;
+        ++st.gen;
+        queueArm(fd, st);
+    }
+
+    if (cqe->res < 0)
+    {
+        if (cqe->res == -ECANCELED)
+        {
+            return;
+        }
+        LOG_ERROR("io_uring poll fd=%d error:%d \n", fd, -cqe->res);
+        st.revents |= EPOLLERR;
+    }
+    else
+    {
+        st.revents |= cqe->res;
+    }
+
+    // 同一个fd在一轮中的多个完成事件合并成一个活跃channel
+    if (st.round != round_)
+    {
+        st.round = round_;
+        activeFds_.push_back(fd);
+    }
+}
+
+bool IoUringPoller::completionSupported()
+{
+    if (completionSupported_ < 0)
+    {
+        // multishot recv(6.0)没有单独的特性位, 用同一版本引入的SEND_ZC判断
+        completionSupported_ = valid()
+            && ring_.opSupported(IORING_OP_SEND_ZC)
+            && ring_.opSupported(IORING_OP_SHUTDOWN)
+            && ring_.opSupported(IORING_OP_ASYNC_CANCEL)
+            && bufferRing() != nullptr;
+    }
+    return completionSupported_ == 1;
+}
+
+io_uring_sqe* IoUringPoller::prepareOp(IoUringOp *op, const std::shared_ptr<void> &guard)
+{
+    io_uring_sqe *sqe = ring_.getSqe();
+    if (sqe == nullptr)
+    {
+        LOG_FATAL("io_uring submission queue full \n");
+    }
+    sqe->user_data = kCompletionOp | reinterpret_cast<uint64_t>(op);
+    op->guard = guard;
+    ++op->inflight;
+    return sqe;
+}
+
+void IoUringPoller::cancelOp(IoUringOp *op)
+{
+    if (op->inflight == 0)
+    {
+        return;
+    }
+    io_uring_sqe *sqe = ring_.getSqe();
+    if (sqe == nullptr)
+    {
+        LOG_FATAL("io_uring submission queue full \n");
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = kCompletionOp | reinterpret_cast<uint64_t>(op);
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = kInternalOp;
+}
+
+IoUringBufferRing* IoUringPoller::bufferRing()
+{
+    if (!bufferRing_)
+    {
+        bufferRing_.reset(new IoUringBufferRing(&ring_, kBufferGroupId, kBufferCount, kBufferSize));
+        if (!bufferRing_->valid())
+        {
+            bufferRing_.reset();
+            return nullptr;
+        }
+    }
+    return bufferRing_.get();
+}
+
+void IoUringPoller::runCompletions(Timestamp receiveTime)
+{
+    if (completions_.empty())
+    {
+        return;
+    }
+
+    std::vector<Completion> completions;
+    completions.swap(completions_);
+    for (const Completion &c : completions)
+    {
+        IoUringOp *op = c.op;
+        std::shared_ptr<void> guard;
+        if (!(c.flags & IORING_CQE_F_MORE) && --op->inflight == 0)
+        {
+            // 最后一个完成事件, 回调之后释放所属对象
+            guard.swap(op->guard);
+        }
+        op->handler(c.res, c.flags, receiveTime);
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef _IOURINGPOLLER_H_
+#define _IOURINGPOLLER_H_
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <stdint.h>
+
+#include "Poller.h"
+#include "Timestamp.h"
+#include "IoUring.h"
+
+/*
+io_uring的使用(用IORING_OP_POLL_ADD代替epoll_ctl/epoll_wait)
+1. 注册/修改/删除channel只是往提交队列中写入POLL_ADD/POLL_REMOVE, 不产生系统调用
+2. poll()中一次io_uring_enter把积攒的提交项交给内核, 同时等待完成事件
+
+水平触发的channel使用单次poll, 事件返回后在下一次poll()时重新注册, 保证和epoll的LT语义一致
+边沿触发的channel使用multishot poll, 注册一次之后一直有效
+
+除了就绪通知, 还支持完成模式: 直接提交recv/send/accept等操作(IoUringOp), 完成事件在poll()返回前回调
+*/
+
+class Channel;
+
+// 完成模式下的一个异步操作, 提交时user_data指向它
+struct IoUringOp
+{
+    using Handler = std::function<void(int res, unsigned flags, Timestamp receiveTime)>;
+
+    IoUringOp() : inflight(0) {}
+
+    Handler handler;
+    std::shared_ptr<void> guard;    // 操作在途期间保证所属对象存活, 最后一个完成事件回调之后释放
+    int inflight;                   // 在途的提交次数
+};
+
+class IoUringPoller : public Poller
+{
+public:
+    IoUringPoller(EventLoop *loop);
+    ~IoUringPoller() override;
+
+    // 内核不支持需要的特性时返回false, 由调用方回退到epoll
+    bool valid() const;
+
+    // 重写基类Poller的抽象方法
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+    void updateChannel(Channel *channel) override;
+    void removeChannel(Channel *channel) override;
+
+    // 完成模式需要的内核特性(multishot recv/accept, 缓冲区组)是否都具备, 只能在所属loop线程调用
+    bool completionSupported();
+    // 获取一个提交项并和op绑定, 由调用方填写操作码和参数, 完成事件回调op->handler
+    io_uring_sqe* prepareOp(IoUringOp *op, const std::shared_ptr<void> &guard);
+    // 取消op所有在途的操作
+    void cancelOp(IoUringOp *op);
+    // 内核是否支持某个操作码
+    bool opSupported(int op) const { return ring_.opSupported(op); }
+    // recv使用的接收缓冲区组, 第一次使用时创建, 由loop上的所有连接共享
+    IoUringBufferRing* bufferRing();
+private:
+    static const unsigned kRingEntries = 256;
+    static const int kBufferGroupId = 0;
+    static const unsigned kBufferCount = 256;         // 必须是2的幂
+    static const unsigned kBufferSize = 16 * 1024;
+
+    // 每个fd在io_uring中的注册状态
+    struct FdState
+    {
+        FdState() : channel(nullptr), gen(0), mask(0), armed(false), queued(false), revents(0), round(0) {}
+
+        Channel *channel;
+        uint32_t gen;           // 每次重新注册加1, 用来丢弃旧注册的完成事件
+        uint32_t mask;          // 当前注册的事件
+        bool armed;             // 是否有一个有效的POLL_ADD在内核中
+        bool queued;            // 是否在rearm_中等待重新注册
+        int revents;            // 本轮收集到的事件
+        uint64_t round;         // 最后一次加入活跃列表的轮次
+    };
+
+    FdState& state(int fd);
+    // 提交POLL_ADD
+    void arm(int fd, FdState &st);
+    // 提交POLL_REMOVE, 并让已经在途的完成事件失效
+    void disarm(int fd, FdState &st);
+    // 等到下一次poll()时再注册
+    void queueArm(int fd, FdState &st);
+    void handleCqe(const io_uring_cqe *cqe);
+    void runCompletions(Timestamp receiveTime);
+
+    struct Completion
+    {
+        IoUringOp *op;
+        int res;
+        unsigned flags;
+    };
+
+    IoUring ring_;
+    std::vector<FdState> fds_;
+    std::vector<int> rearm_;        // 等待重新注册的fd
+    std::vector<int> activeFds_;    // 本轮有事件发生的fd
+    std::vector<Completion> completions_;   // 本轮完成的op
+    uint64_t round_;
+    std::unique_ptr<IoUringBufferRing> bufferRing_;
+    int completionSupported_;       // -1表示还没有检测
+};
+
+#endif
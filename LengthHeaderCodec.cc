@@ -0,0 +1,80 @@
+#include "LengthHeaderCodec.h"
+#include "Buffer.h"
+#include "TcpConnection.h"
+#include "Logger.h"
+
+#include <string.h>
+#include <endian.h>
+
+LengthHeaderCodec::LengthHeaderCodec(const FramesCallback &cb, size_t maxFrameSize)
+    : framesCallback_(cb)
+    , maxFrameSize_(maxFrameSize)
+{
+}
+
+void LengthHeaderCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    // 每个loop线程复用一个帧列表, 解析一批帧不需要分配内存
+    thread_local FrameList frames;
+    frames.clear();
+
+    const char *p = buf->peek();
+    size_t remain = buf->readableBytes();
+    bool invalid = false;
+    while (remain >= kHeaderLen)
+    {
+        uint32_t be;
+        memcpy(&be, p, sizeof be);
+        const int32_t len = static_cast<int32_t>(be32toh(be));
+        if (len < 0 || static_cast<size_t>(len) > maxFrameSize_)
+        {
+            LOG_ERROR("LengthHeaderCodec::onMessage [%s] invalid frame length %d, max %zu \n",
+                conn->name().c_str(), len, maxFrameSize_);
+            invalid = true;
+            break;
+        }
+        if (remain < kHeaderLen + len)
+        {
+            break;
+        }
+        frames.push_back(StringPiece(p + kHeaderLen, len));
+        p += kHeaderLen + len;
+        remain -= kHeaderLen + len;
+    }
+
+    if (!frames.empty())
+    {
+        framesCallback_(conn, frames, receiveTime);
+        // 回调返回之后才丢弃这些帧, 保证回调期间StringPiece指向的数据有效
+        buf->retrieve(p - buf->peek());
+        frames.clear();
+    }
+
+    if (invalid)
+    {
+        // 坏帧之前的完整帧已经交给用户, 后面的数据无法再分帧, 全部丢弃
+        buf->retrieveAll();
+        conn->forceClose();
+    }
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, const StringPiece &frame)
+{
+    Buffer buf(frame.size());
+    buf.append(frame.data(), frame.size());
+    send(conn, &buf);
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, Buffer *frame)
+{
+    if (frame->readableBytes() > maxFrameSize_)
+    {
+        LOG_ERROR("LengthHeaderCodec::send [%s] frame too large %zu, max %zu \n",
+            conn->name().c_str(), frame->readableBytes(), maxFrameSize_);
+        frame->retrieveAll();
+        return;
+    }
+    // 长度头写进kCheapPrepend预留的空间, 不移动消息体
+    frame->prependInt32(static_cast<int32_t>(frame->readableBytes()));
+    conn->send(frame);
+}
@@ -0,0 +1,50 @@
+#ifndef _LENGTHHEADERCODEC_H_
+#define _LENGTHHEADERCODEC_H_
+
+#include <functional>
+#include <vector>
+#include <stdint.h>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "StringPiece.h"
+#include "Timestamp.h"
+
+class Buffer;
+
+/*
+ * 4字节网络字节序长度头的分帧编解码器, 位于TcpConnection和应用之间
+ * 接收: 把onMessage注册为连接的MessageCallback, 一次回调中所有完整的帧作为一批交给FramesCallback,
+ *       每一帧是指向输入缓冲区的StringPiece, 不拷贝, 只在回调期间有效, 回调返回之后这些数据才被retrieve
+ *       不完整的帧留在缓冲区中等待更多数据
+ * 发送: 消息体写在Buffer中, 长度头直接写进Buffer前面kCheapPrepend的预留空间, 然后整体交给连接发送
+ * 长度为负或超过maxFrameSize的帧视为协议错误, 它之前的完整帧照常交付, 之后的数据全部丢弃并强制关闭连接
+ * 编解码器本身没有按连接保存的状态, 可以被多个loop线程中的连接共用
+*/
+class LengthHeaderCodec : noncopyable
+{
+public:
+    using FrameList = std::vector<StringPiece>;
+    using FramesCallback = std::function<void(const TcpConnectionPtr&, const FrameList&, Timestamp)>;
+
+    static const size_t kHeaderLen = sizeof(int32_t);
+    static const size_t kDefaultMaxFrameSize = 64 * 1024 * 1024;
+
+    explicit LengthHeaderCodec(const FramesCallback &cb, size_t maxFrameSize = kDefaultMaxFrameSize);
+
+    size_t maxFrameSize() const { return maxFrameSize_; }
+
+    // 注册给TcpServer::setMessageCallback
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    // 拷贝frame到新的Buffer, 加上长度头后发送
+    void send(const TcpConnectionPtr &conn, const StringPiece &frame);
+    // frame中的可读数据作为一帧, 在原地加上长度头后换走frame的存储发送, frame变为空
+    void send(const TcpConnectionPtr &conn, Buffer *frame);
+
+private:
+    FramesCallback framesCallback_;
+    const size_t maxFrameSize_;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef _LOGFILE_H_
+#define _LOGFILE_H_
+
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <memory>
+
+#include "noncopyable.h"
+
+/*
+ * 滚动日志文件, 只在AsyncLogging的后台线程中使用, 不加锁
+ * 1. 写入的字节数超过rollSize时滚动
+ * 2. 跨过rollInterval的整数倍时间点(默认每天零点)时滚动
+ * 文件名: basename.20250101-120000.hostname.pid.log, 同一秒内再次滚动时追加序号 .1 .2 ...
+*/
+class LogFile : noncopyable
+{
+public:
+    LogFile(const std::string &basename,
+            off_t rollSize,
+            int flushInterval = 3,
+            int rollInterval = kRollPerSeconds);
+    ~LogFile();
+
+    void append(const char *logline, size_t len);
+    void flush();
+    // 打开一个新的日志文件
+    bool rollFile();
+
+    static const int kRollPerSeconds = 60 * 60 * 24;
+private:
+    static std::string getLogFileName(const std::string &basename, time_t *now);
+
+    const std::string basename_;
+    const off_t rollSize_;
+    const int flushInterval_;
+    const int rollInterval_;
+    const int checkEveryN_;     // 每写入checkEveryN_次检查一次是否需要按时间滚动或刷盘
+
+    int count_;
+    off_t writtenBytes_;
+    time_t startOfPeriod_;      // 当前日志文件所属的时间段起点
+    time_t lastRoll_;
+    time_t lastFlush_;
+    int rollIndex_;             // 同一秒内滚动的次数
+
+    FILE *fp_;
+    char buffer_[64 * 1024];    // FILE的用户态缓冲区, 减少write系统调用
+};
+
+#endif
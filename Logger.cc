@@ -1,8 +1,38 @@
-#include <iostream>
-
 #include "Logger.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdarg.h>
+
 #include "Timestamp.h"
 
+namespace
+{
+
+void defaultOutput(const char *msg, size_t len)
+{
+    ::fwrite(msg, 1, len, stdout);
+}
+
+void defaultFlush()
+{
+    ::fflush(stdout);
+}
+
+Logger::OutputFunc g_output = defaultOutput;
+Logger::FlushFunc g_flush = defaultFlush;
+
+// 每个线程缓存格式化好的时间, 同一秒内的日志不再调用localtime
+__thread time_t t_lastSecond = 0;
+__thread char t_time[32];
+__thread int t_timeLen = 0;
+
+}
+
+std::atomic_int Logger::logLevel_(MUDUO_MIN_LOG_LEVEL);
+std::atomic_bool Logger::binaryMode_(false);
+
 // 获取日志唯一的实例对象
 Logger& Logger::instance()
 {
@@ -10,33 +40,95 @@ Logger& Logger::instance()
     return logger;
 }
 
-// 设置日志级别
-void Logger::setLogLevel(int level)
+void Logger::setBinaryMode(bool on)
 {
-    logLevel_ = level;
+    if (on)
+    {
+        BinaryLog::start();
+        binaryMode_ = true;
+    }
+    else
+    {
+        binaryMode_ = false;
+        BinaryLog::stop();
+    }
+}
+
+void Logger::setOutput(OutputFunc out)
+{
+    g_output = std::move(out);
+}
+
+void Logger::setFlush(FlushFunc flush)
+{
+    g_flush = std::move(flush);
+}
+
+void Logger::flush()
+{
+    g_flush();
+}
+
+void Logger::logf(int level, const char *fmt, ...)
+{
+    // 只在确定需要输出时才格式化, 不需要清零
+    char buf[1024];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof buf, fmt, args);
+    va_end(args);
+    log(level, buf);
+}
+
+void Logger::log(int level, const char *msg)
+{
+    log(level, msg, Timestamp::now());
 }
 
 // 写日志 [级别信息] time : msg
-void Logger::log(std::string msg)
+void Logger::log(int level, const char *msg, Timestamp time)
 {
-    switch (logLevel_)
+    const char *levelName = "";
+    switch (level)
     {
     case INFO:
-        std::cout << "[INFO]";
+        levelName = "[INFO]";
         break;
     case ERROR:
-        std::cout << "[ERROR]";
+        levelName = "[ERROR]";
         break;
     case FATAL:
-        std::cout << "[FATAL]";
+        levelName = "[FATAL]";
         break;
     case DEBUG:
-        std::cout << "[DEBUG]";
+        levelName = "[DEBUG]";
         break;
     default:
         break;
     }
 
-    // 打印时间和msg
-    std::cout << Timestamp::now().toString() << " : " << msg << std::endl;
-}
\ No newline at end of file
+    time_t seconds = time.secondsSinceEpoch();
+    if (seconds != t_lastSecond)
+    {
+        t_lastSecond = seconds;
+        tm tm_time;
+        ::localtime_r(&seconds, &tm_time);
+        t_timeLen = snprintf(t_time, sizeof t_time, "%4d/%02d/%02d %02d:%02d:%02d",
+            tm_time.tm_year + 1900,
+            tm_time.tm_mon + 1,
+            tm_time.tm_mday,
+            tm_time.tm_hour,
+            tm_time.tm_min,
+            tm_time.tm_sec);
+    }
+
+    // 打印时间和msg, 一条日志只调用一次输出函数
+    char line[1200];
+    int len = snprintf(line, sizeof line, "%s%.*s : %s\n", levelName, t_timeLen, t_time, msg);
+    if (len >= static_cast<int>(sizeof line))
+    {
+        len = sizeof line - 1;
+        line[len - 1] = '\n';
+    }
+    g_output(line, len);
+}
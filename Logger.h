@@ -2,78 +2,108 @@
 #define _LOGGER_H_
 
 #include <string>
+#include <functional>
+#include <atomic>
+#include <stdlib.h>
 
 #include "noncopyable.h"
+#include "Timestamp.h"
+#include "BinaryLog.h"
 
-// LOG_INFO("%s %d", arg1, arg2)
-#define LOG_INFO(logmsgFormat, ...)\
-    do \
-    { \
-        Logger &logger = Logger::instance(); \
-        logger.setLogLevel(INFO); \
-        char buf[1024] = {0}; \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf); \
-    } while (0);
-    
-#define LOG_ERROR(logmsgFormat, ...)\
+// 定义日志的级别  DEBUG  INFO  ERROR  FATAL, 按严重程度递增
+enum LogLevel
+{
+    DEBUG,      // 调试信息
+    INFO,       // 普通信息
+    ERROR,      // 错误信息
+    FATAL,      // core信息
+};
+
+/*
+ * 编译期的最低日志级别, 低于该级别的日志语句在编译期就被消除, 参数也不会求值
+ * 默认定义了MUDEBUG时为DEBUG, 否则为INFO, 也可以通过 -DMUDUO_MIN_LOG_LEVEL=2 直接指定
+*/
+#ifndef MUDUO_MIN_LOG_LEVEL
+#ifdef MUDEBUG
+#define MUDUO_MIN_LOG_LEVEL 0
+#else
+#define MUDUO_MIN_LOG_LEVEL 1
+#endif
+#endif
+
+/*
+ * 先判断编译期和运行期的级别, 不需要输出的日志不会格式化, 也不会访问任何共享的可写状态
+ * 日志级别作为参数随每条日志传递, 不再修改Logger单例的状态
+ * 二进制模式下只记录格式串指针和原始参数, 由后台线程格式化
+*/
+#define LOG_IMPL(level, logmsgFormat, ...) \
     do \
     { \
-        Logger &logger = Logger::instance(); \
-        logger.setLogLevel(ERROR); \
-        char buf[1024] = {0}; \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf); \
-    } while (0);
+        if (MUDUO_MIN_LOG_LEVEL <= level && Logger::logLevel() <= level) \
+        { \
+            if (Logger::binaryMode()) \
+            { \
+                BinaryLog::record(level, logmsgFormat, ##__VA_ARGS__); \
+            } \
+            else \
+            { \
+                Logger::instance().logf(level, logmsgFormat, ##__VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
+// LOG_INFO("%s %d", arg1, arg2)
+#define LOG_INFO(logmsgFormat, ...) LOG_IMPL(INFO, logmsgFormat, ##__VA_ARGS__)
 
+#define LOG_ERROR(logmsgFormat, ...) LOG_IMPL(ERROR, logmsgFormat, ##__VA_ARGS__)
+
+// FATAL日志总是同步格式化输出, 然后退出进程
 #define LOG_FATAL(logmsgFormat, ...)\
     do \
     { \
         Logger &logger = Logger::instance(); \
-        logger.setLogLevel(FATAL); \
-        char buf[1024] = {0}; \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf); \
+        logger.logf(FATAL, logmsgFormat, ##__VA_ARGS__); \
+        logger.flush(); \
         exit(-1); \
-    } while (0);
-
-#ifdef MUDEBUG
-#define LOG_DEBUG(logmsgFormat, ...)\
-    do \
-    { \
-        Logger &logger = Logger::instance(); \
-        logger.setLogLevel(DEBUG); \
-        char buf[1024] = {0}; \
-        snprintf(buf, 1024, logmsgFormat, ##__VA_ARGS__); \
-        logger.log(buf); \
-    } while (0);
-#else
-    #define LOG_DEBUG(logmsgFormat, ...)
-#endif 
-
-// 定义日志的级别  INFO  ERROR  FATAL  DEBUG 
-enum LogLevel
-{
-    INFO,       // 普通信息
-    ERROR,      // 错误信息
-    FATAL,      // core信息
-    DEBUG,      // 调试信息
-};
+    } while (0)
 
+#define LOG_DEBUG(logmsgFormat, ...) LOG_IMPL(DEBUG, logmsgFormat, ##__VA_ARGS__)
 
 // 输出一个日志类
 class Logger : noncopyable
 {
 public:
+    // 日志的输出目的地, 默认写到stdout, 可以替换成AsyncLogging::append
+    using OutputFunc = std::function<void(const char *msg, size_t len)>;
+    using FlushFunc = std::function<void()>;
+
     // 获取日志唯一的实例对象
     static Logger& instance();
-    // 设置日志级别
-    void setLogLevel(int level);
-    // 写日志
-    void log(std::string msg);
+
+    // 运行期的最低日志级别, 线程安全
+    static int logLevel() { return logLevel_.load(std::memory_order_relaxed); }
+    static void setLogLevel(int level) { logLevel_.store(level, std::memory_order_relaxed); }
+
+    // 开启二进制日志模式, 会启动后台格式化线程, 关闭时把已记录的日志处理完
+    static bool binaryMode() { return binaryMode_.load(std::memory_order_relaxed); }
+    static void setBinaryMode(bool on);
+
+    // 格式化并写日志
+    void logf(int level, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+    // 写一条已经格式化好的日志
+    void log(int level, const char *msg);
+    void log(int level, const char *msg, Timestamp time);
+    // 把已经输出的日志刷到目的地
+    void flush();
+
+    // 在启动其他线程之前设置
+    static void setOutput(OutputFunc out);
+    static void setFlush(FlushFunc flush);
 private:
-    int logLevel_;
     Logger() {}
+
+    static std::atomic_int logLevel_;
+    static std::atomic_bool binaryMode_;
 };
 
-#endif
\ No newline at end of file
+#endif
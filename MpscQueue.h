@@ -0,0 +1,105 @@
+#ifndef _MPSCQUEUE_H_
+#define _MPSCQUEUE_H_
+
+#include <atomic>
+#include <utility>
+#include <thread>
+
+#include "noncopyable.h"
+
+/*
+ * 无锁的多生产者单消费者队列(Dmitry Vyukov的MPSC节点队列)
+ * 生产者: 一次原子exchange把新节点挂到head_上, 再把前驱的next指向它, 不需要CAS重试
+ * 消费者: 只有一个线程, 从tail_沿着next链表向前取, 不需要同步
+ * tail_始终指向一个值已经被取走的哑节点, 所以T需要可以默认构造
+ * 
+ * 生产者在exchange和设置next之间被挂起时, 消费者会暂时看不到后面的节点(链表断开),
+ * drain会在这种情况下等待生产者完成链接, 保证调用时已经入队的元素都能被取出
+*/
+template <typename T>
+class MpscQueue : noncopyable
+{
+public:
+    MpscQueue()
+        : head_(new Node)
+        , tail_(head_.load(std::memory_order_relaxed))
+    {}
+
+    ~MpscQueue()
+    {
+        Node *node = tail_;
+        while (node)
+        {
+            Node *next = node->next.load(std::memory_order_relaxed);
+            delete node;
+            node = next;
+        }
+    }
+
+    // 可以在任意线程调用
+    void push(T value)
+    {
+        Node *node = new Node(std::move(value));
+        Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // 以下接口只能在消费者线程调用
+    bool empty() const
+    {
+        return tail_ == head_.load(std::memory_order_acquire);
+    }
+
+    bool pop(T &value)
+    {
+        Node *next = tail_->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+        {
+            return false;
+        }
+        value = std::move(next->value);
+        delete tail_;
+        tail_ = next;
+        return true;
+    }
+
+    // 批量取出调用时已经入队的所有元素, 对每个元素调用func, 返回取出的个数
+    // 执行func过程中新入队的元素留给下一次drain, 防止一直有新元素时消费者无法返回
+    template <typename Func>
+    size_t drain(Func func)
+    {
+        Node *last = head_.load(std::memory_order_acquire);
+        size_t count = 0;
+        while (tail_ != last)
+        {
+            Node *next = tail_->next.load(std::memory_order_acquire);
+            if (next == nullptr)
+            {
+                // 生产者已经exchange了head_但还没有链接next, 很快就会完成
+                std::this_thread::yield();
+                continue;
+            }
+            T value(std::move(next->value));
+            delete tail_;
+            tail_ = next;
+            ++count;
+            func(value);
+        }
+        return count;
+    }
+private:
+    struct Node
+    {
+        Node() : next(nullptr) {}
+        explicit Node(T &&v) : next(nullptr), value(std::move(v)) {}
+
+        std::atomic<Node*> next;
+        T value;
+    };
+
+    std::atomic<Node*> head_;       // 最近入队的节点, 生产者竞争
+    char pad_[64 - sizeof(std::atomic<Node*>)];     // 避免head_和tail_的伪共享
+    Node *tail_;                    // 哑节点, 只有消费者访问
+};
+
+#endif
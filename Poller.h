@@ -16,6 +16,14 @@ class Poller : noncopyable
 public:
     using ChannelList = std::vector<Channel*>;
 
+    // IO复用的具体实现, kDefaultPoller由环境变量决定
+    enum PollerType
+    {
+        kDefaultPoller,
+        kEPollPoller,
+        kIoUringPoller,
+    };
+
     Poller(EventLoop *loop);
     virtual ~Poller() = default;
 
@@ -29,6 +37,8 @@ public:
 
     // EventLoop可以用过该接口获取默认的IO复用的具体实现
     static Poller* newDefaultPoller(EventLoop *loop);       // 在单独的文件实现: 
+    // 获取指定类型的IO复用实现, io_uring不可用时回退到epoll
+    static Poller* newPoller(EventLoop *loop, int type);
 
 protected:
     // map的key: sockfd  value: sockfd所有的Channel通道类型
@@ -0,0 +1,77 @@
+#include "Slab.h"
+#include "Logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+Slab::Slab()
+    : bytesReserved_(0)
+{
+    memset(freeLists_, 0, sizeof freeLists_);
+}
+
+Slab::~Slab()
+{
+    for (void *chunk : chunks_)
+    {
+        ::free(chunk);
+    }
+}
+
+void* Slab::allocate(size_t size)
+{
+    if (size == 0 || size > kMaxBlockSize)
+    {
+        return ::operator new(size);
+    }
+
+    const size_t cls = (size - 1) / kAlign;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (freeLists_[cls] == nullptr)
+    {
+        // 这一级没有空闲块了, 切一个新的大块
+        const size_t blockSize = (cls + 1) * kAlign;
+        void *chunk = nullptr;
+        if (::posix_memalign(&chunk, kAlign, blockSize * kBlocksPerChunk) != 0)
+        {
+            LOG_ERROR("Slab::allocate posix_memalign failed, size:%zu \n", blockSize * kBlocksPerChunk);
+            throw std::bad_alloc();
+        }
+        chunks_.push_back(chunk);
+        bytesReserved_ += blockSize * kBlocksPerChunk;
+
+        char *p = static_cast<char*>(chunk);
+        for (size_t i = 0; i < kBlocksPerChunk; ++i)
+        {
+            FreeBlock *block = reinterpret_cast<FreeBlock*>(p + i * blockSize);
+            block->next = freeLists_[cls];
+            freeLists_[cls] = block;
+        }
+    }
+
+    FreeBlock *block = freeLists_[cls];
+    freeLists_[cls] = block->next;
+    return block;
+}
+
+void Slab::deallocate(void *p, size_t size)
+{
+    if (size == 0 || size > kMaxBlockSize)
+    {
+        ::operator delete(p);
+        return;
+    }
+
+    const size_t cls = (size - 1) / kAlign;
+    FreeBlock *block = static_cast<FreeBlock*>(p);
+    std::lock_guard<std::mutex> lock(mutex_);
+    block->next = freeLists_[cls];
+    freeLists_[cls] = block;
+}
+
+size_t Slab::bytesReserved() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytesReserved_;
+}
@@ -0,0 +1,92 @@
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#include <stddef.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "noncopyable.h"
+
+/*
+ * 按大小分级的定长内存池, 每个EventLoop一个, 用于分配连接对象
+ * 每一级的块大小是kAlign的整数倍, 块从kBlocksPerChunk个块组成的大块中切出, 首地址按cache line对齐
+ * 释放的块挂回对应级别的空闲链表, 内存只在Slab析构时还给系统
+ * 连接在mainLoop中创建、在subLoop中销毁, 所以allocate/deallocate用互斥锁保护, 临界区只有几次指针操作
+*/
+class Slab : noncopyable
+{
+public:
+    static const size_t kAlign = 64;                // 块大小的粒度, 也是块的对齐
+    static const size_t kMaxBlockSize = 4096;       // 超过这个大小的请求直接使用operator new
+    static const size_t kBlocksPerChunk = 64;
+
+    Slab();
+    ~Slab();
+
+    void* allocate(size_t size);
+    void deallocate(void *p, size_t size);
+
+    // 从系统申请的总字节数
+    size_t bytesReserved() const;
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    mutable std::mutex mutex_;
+    FreeBlock *freeLists_[kMaxBlockSize / kAlign];
+    std::vector<void*> chunks_;
+    size_t bytesReserved_;
+};
+
+/*
+ * 使用Slab的标准分配器, 配合std::allocate_shared把对象和shared_ptr的控制块放在同一个块中
+ * 控制块保存分配器的拷贝, 所以最后一个对象释放之前Slab不会析构
+*/
+template <typename T>
+class SlabAllocator
+{
+public:
+    using value_type = T;
+
+    explicit SlabAllocator(std::shared_ptr<Slab> slab)
+        : slab_(std::move(slab))
+    {}
+
+    template <typename U>
+    SlabAllocator(const SlabAllocator<U> &other)
+        : slab_(other.slab())
+    {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(slab_->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        slab_->deallocate(p, n * sizeof(T));
+    }
+
+    const std::shared_ptr<Slab>& slab() const { return slab_; }
+
+private:
+    std::shared_ptr<Slab> slab_;
+};
+
+template <typename T, typename U>
+bool operator==(const SlabAllocator<T> &lhs, const SlabAllocator<U> &rhs)
+{
+    return lhs.slab() == rhs.slab();
+}
+
+template <typename T, typename U>
+bool operator!=(const SlabAllocator<T> &lhs, const SlabAllocator<U> &rhs)
+{
+    return !(lhs == rhs);
+}
+
+#endif
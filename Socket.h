@@ -29,6 +29,8 @@ public:
     void setReusePort(bool on);
     // 设置长连接
     void setKeepAlive(bool on);
+    // 允许MSG_ZEROCOPY发送, 内核不支持时返回false
+    bool setZeroCopy(bool on);
 
 private:
     const int sockfd_;
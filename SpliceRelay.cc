@@ -0,0 +1,296 @@
+#include "SpliceRelay.h"
+
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "Logger.h"
+#include "EventLoop.h"
+#include "TcpConnection.h"
+
+const int SpliceRelay::kPipeSize;
+const int SpliceRelay::kMaxSplicePerEvent;
+
+std::shared_ptr<SpliceRelay> SpliceRelay::start(const TcpConnectionPtr &downstream,
+                                                const TcpConnectionPtr &upstream)
+{
+    std::shared_ptr<SpliceRelay> relay(new SpliceRelay(downstream, upstream));
+    if (!relay->init())
+    {
+        downstream->forceClose();
+        upstream->forceClose();
+        return std::shared_ptr<SpliceRelay>();
+    }
+    relay->self_ = relay;
+
+    // 转发接管之前已经读到的数据, 以及已经在socket中的数据
+    relay->pump(kToUpstream);
+    relay->pump(kToDownstream);
+    return relay;
+}
+
+SpliceRelay::SpliceRelay(const TcpConnectionPtr &downstream, const TcpConnectionPtr &upstream)
+    : loop_(downstream->getLoop())
+    , finished_(false)
+{
+    conns_[kToUpstream] = downstream;
+    conns_[kToDownstream] = upstream;
+    for (int i = 0; i < kNumDirections; ++i)
+    {
+        Direction &d = dirs_[i];
+        d.src = conns_[i].get();
+        d.dst = conns_[kNumDirections - 1 - i].get();
+        d.pipefd[0] = d.pipefd[1] = -1;
+        d.pending = 0;
+        d.srcEof = false;
+        d.dstShutdown = false;
+        d.bytes = 0;
+    }
+}
+
+SpliceRelay::~SpliceRelay()
+{
+    for (int i = 0; i < kNumDirections; ++i)
+    {
+        for (int fd : dirs_[i].pipefd)
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+    }
+}
+
+bool SpliceRelay::init()
+{
+    if (conns_[kToDownstream]->getLoop() != loop_ || !loop_->isInLoopThread())
+    {
+        LOG_ERROR("SpliceRelay::start [%s] <-> [%s] - connections must be in the same loop thread \n",
+            conns_[kToUpstream]->name().c_str(), conns_[kToDownstream]->name().c_str());
+        return false;
+    }
+
+    for (int i = 0; i < kNumDirections; ++i)
+    {
+        Direction &d = dirs_[i];
+        if (::pipe2(d.pipefd, O_NONBLOCK | O_CLOEXEC) < 0)
+        {
+            LOG_ERROR("SpliceRelay::init pipe2 errno:%d \n", errno);
+            return false;
+        }
+        // 扩大管道, 减少大流量时的splice次数; 超过系统上限时保持默认大小
+        ::fcntl(d.pipefd[1], F_SETPIPE_SZ, kPipeSize);
+    }
+
+    // 回调只持有弱引用, 中继结束之后连接上残留的事件不会访问已经释放的中继
+    std::weak_ptr<SpliceRelay> weakSelf(shared_from_this());
+    for (int i = 0; i < kNumDirections; ++i)
+    {
+        bool ok = conns_[i]->takeOverIo(
+            [weakSelf, i](Timestamp) {
+                std::shared_ptr<SpliceRelay> relay = weakSelf.lock();
+                if (relay)
+                {
+                    relay->handleReadable(i);
+                }
+            },
+            [weakSelf, i] {
+                std::shared_ptr<SpliceRelay> relay = weakSelf.lock();
+                if (relay)
+                {
+                    relay->handleWritable(i);
+                }
+            },
+            [weakSelf] {
+                std::shared_ptr<SpliceRelay> relay = weakSelf.lock();
+                if (relay)
+                {
+                    relay->handleClose();
+                }
+            },
+            &dirs_[i].leftover);
+        if (!ok)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// conns_[which]可读: 方向which的源有数据
+void SpliceRelay::handleReadable(int which)
+{
+    pump(which);
+}
+
+// conns_[which]可写: 它是另一个方向的目的端, 继续写管道中积压的数据
+void SpliceRelay::handleWritable(int which)
+{
+    pump(kNumDirections - 1 - which);
+}
+
+void SpliceRelay::pump(int dir)
+{
+    if (finished_)
+    {
+        return;
+    }
+
+    Direction &d = dirs_[dir];
+    int splices = 0;
+    bool blocked = false;
+    while (splices < kMaxSplicePerEvent)
+    {
+        // 先把管道排空, dst写不进去时不再从src读, 数据留在src的接收缓冲区里, 由TCP流控反压到对端
+        if (!flush(d))
+        {
+            blocked = true;
+            break;
+        }
+        if (d.srcEof)
+        {
+            break;
+        }
+
+        ssize_t n = ::splice(d.src->fd(), nullptr, d.pipefd[1], nullptr, kPipeSize,
+                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        ++splices;
+        if (n > 0)
+        {
+            d.pending += n;
+        }
+        else if (n == 0)
+        {
+            d.srcEof = true;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            break;
+        }
+        else
+        {
+            LOG_ERROR("SpliceRelay::pump [%s] splice from socket errno:%d %s \n",
+                d.src->name().c_str(), errno, strerror(errno));
+            finish();
+            return;
+        }
+    }
+
+    if (finished_)
+    {
+        return;
+    }
+
+    if (!blocked && splices == kMaxSplicePerEvent && !d.srcEof)
+    {
+        // 预算用完了, src中可能还有数据, ET模式不会再通知, 下一轮loop继续
+        loop_->queueInLoop(std::bind(&SpliceRelay::pump, shared_from_this(), dir));
+    }
+
+    if (d.srcEof && d.pending == 0 && d.leftover.readableBytes() == 0 && !d.dstShutdown)
+    {
+        // 半关闭传递给另一侧, 另一个方向仍然可以继续转发
+        d.dstShutdown = true;
+        ::shutdown(d.dst->fd(), SHUT_WR);
+    }
+
+    if (dirs_[kToUpstream].dstShutdown && dirs_[kToDownstream].dstShutdown)
+    {
+        finish();
+        return;
+    }
+    updateInterest();
+}
+
+bool SpliceRelay::flush(Direction &d)
+{
+    while (d.leftover.readableBytes() > 0)
+    {
+        ssize_t n = ::send(d.dst->fd(), d.leftover.peek(), d.leftover.readableBytes(), MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            d.leftover.retrieve(n);
+            d.bytes += n;
+        }
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return false;
+        }
+        else
+        {
+            LOG_ERROR("SpliceRelay::flush [%s] send errno:%d %s \n", d.dst->name().c_str(), errno, strerror(errno));
+            finish();
+            return false;
+        }
+    }
+    if (d.leftover.capacity() > 0)
+    {
+        d.leftover.shrink(0);
+    }
+
+    while (d.pending > 0)
+    {
+        ssize_t n = ::splice(d.pipefd[0], nullptr, d.dst->fd(), nullptr, d.pending,
+                             SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0)
+        {
+            d.pending -= n;
+            d.bytes += n;
+        }
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return false;
+        }
+        else
+        {
+            LOG_ERROR("SpliceRelay::flush [%s] splice to socket errno:%d %s \n",
+                d.dst->name().c_str(), errno, strerror(errno));
+            finish();
+            return false;
+        }
+    }
+    return true;
+}
+
+// 方向i有积压时关注目的端的可写事件并停止读源端; 源端读到EOF后不再关注可读
+void SpliceRelay::updateInterest()
+{
+    for (int i = 0; i < kNumDirections; ++i)
+    {
+        const Direction &in = dirs_[i];
+        const Direction &out = dirs_[kNumDirections - 1 - i];
+        const bool inBlocked = in.pending > 0 || in.leftover.readableBytes() > 0;
+        const bool outBlocked = out.pending > 0 || out.leftover.readableBytes() > 0;
+        conns_[i]->setIoInterest(!in.srcEof && !inBlocked, outBlocked);
+    }
+}
+
+// 任意一侧的连接被关闭(对端重置、超时、forceClose等)
+void SpliceRelay::handleClose()
+{
+    finish();
+}
+
+void SpliceRelay::finish()
+{
+    if (finished_)
+    {
+        return;
+    }
+    finished_ = true;
+    LOG_INFO("SpliceRelay::finish [%s] <-> [%s] - %lld bytes upstream, %lld bytes downstream \n",
+        conns_[kToUpstream]->name().c_str(), conns_[kToDownstream]->name().c_str(),
+        static_cast<long long>(dirs_[kToUpstream].bytes), static_cast<long long>(dirs_[kToDownstream].bytes));
+
+    for (int i = 0; i < kNumDirections; ++i)
+    {
+        conns_[i]->forceClose();
+    }
+    // 可能正在中继自己的回调中, 延迟释放
+    std::shared_ptr<SpliceRelay> self;
+    self.swap(self_);
+    loop_->queueInLoop([self] {});
+}
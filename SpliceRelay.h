@@ -0,0 +1,73 @@
+#ifndef _SPLICERELAY_H_
+#define _SPLICERELAY_H_
+
+#include <memory>
+#include <stdint.h>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Buffer.h"
+
+class EventLoop;
+
+/*
+ * 四层转发: 把同一个loop上的两个连接首尾相接, 数据用splice()经过内核管道在两个socket之间搬运,
+ * 不进入用户态, 也不经过TcpConnection的输入输出缓冲区
+ * 每个方向一个管道: 源socket可读时splice进管道, 再从管道splice到目的socket
+ * 目的socket写不进去(EAGAIN)时数据留在管道中, 关注目的socket的EPOLLOUT并停止读源socket, 由慢的一方反压
+ * 源socket读到EOF并且管道排空后对目的socket shutdown(SHUT_WR), 半关闭传递到另一侧; 两个方向都结束后关闭两个连接
+ * 任意一侧出错或被关闭(包括超时、forceClose), 另一侧随之关闭
+ * 中继自己持有自己, 两个连接都关闭之后释放, 调用方不需要保存返回值
+ * 对已经重置的socket splice会触发SIGPIPE, 和其他服务器程序一样, 进程应当忽略SIGPIPE
+*/
+class SpliceRelay : noncopyable, public std::enable_shared_from_this<SpliceRelay>
+{
+public:
+    // 在loop线程中调用, 两个连接必须属于同一个loop并且处于就绪模式, 失败时关闭两个连接并返回空
+    static std::shared_ptr<SpliceRelay> start(const TcpConnectionPtr &downstream,
+                                              const TcpConnectionPtr &upstream);
+    ~SpliceRelay();
+
+    // 已经转发的字节数, 只在loop线程中读取
+    int64_t bytesToUpstream() const { return dirs_[kToUpstream].bytes; }
+    int64_t bytesToDownstream() const { return dirs_[kToDownstream].bytes; }
+
+    static const int kPipeSize = 256 * 1024;    // 每个管道的容量, 也是一次splice的最大长度
+    static const int kMaxSplicePerEvent = 16;   // 一次事件最多从源socket splice的次数
+
+private:
+    enum { kToUpstream, kToDownstream, kNumDirections };
+
+    // 一个方向的转发状态
+    struct Direction
+    {
+        TcpConnection *src;
+        TcpConnection *dst;
+        int pipefd[2];
+        size_t pending;         // 管道中还没有写到dst的字节数
+        Buffer leftover;        // 接管之前src已经读进inputBuffer_的数据, 先于管道中的数据发送
+        bool srcEof;
+        bool dstShutdown;
+        int64_t bytes;
+    };
+
+    SpliceRelay(const TcpConnectionPtr &downstream, const TcpConnectionPtr &upstream);
+
+    bool init();
+    void handleReadable(int which);
+    void handleWritable(int which);
+    void pump(int dir);
+    // 把leftover和管道中的数据写给dst, 返回false表示dst暂时写不进去或者出错
+    bool flush(Direction &d);
+    void updateInterest();
+    void handleClose();
+    void finish();
+
+    EventLoop *loop_;
+    TcpConnectionPtr conns_[kNumDirections];    // conns_[i]是方向i的源, 即{downstream, upstream}
+    Direction dirs_[kNumDirections];
+    bool finished_;
+    std::shared_ptr<SpliceRelay> self_;         // 运行期间持有自己
+};
+
+#endif
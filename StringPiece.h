@@ -0,0 +1,61 @@
+#ifndef _STRINGPIECE_H_
+#define _STRINGPIECE_H_
+
+#include <string.h>
+#include <string>
+
+/*
+ * 不持有内存的字符串视图, 只记录指针和长度
+ * 用于把缓冲区中的数据交给用户而不拷贝, 视图的有效期由产生它的一方说明
+*/
+class StringPiece
+{
+public:
+    StringPiece()
+        : ptr_(nullptr)
+        , length_(0)
+    {}
+    StringPiece(const char *str)
+        : ptr_(str)
+        , length_(strlen(str))
+    {}
+    StringPiece(const std::string &str)
+        : ptr_(str.data())
+        , length_(str.size())
+    {}
+    StringPiece(const char *offset, size_t len)
+        : ptr_(offset)
+        , length_(len)
+    {}
+
+    const char* data() const { return ptr_; }
+    size_t size() const { return length_; }
+    bool empty() const { return length_ == 0; }
+    const char* begin() const { return ptr_; }
+    const char* end() const { return ptr_ + length_; }
+
+    char operator[](size_t i) const { return ptr_[i]; }
+
+    void removePrefix(size_t n)
+    {
+        ptr_ += n;
+        length_ -= n;
+    }
+
+    std::string asString() const { return std::string(ptr_, length_); }
+
+    bool operator==(const StringPiece &rhs) const
+    {
+        return length_ == rhs.length_ && memcmp(ptr_, rhs.ptr_, length_) == 0;
+    }
+    bool operator!=(const StringPiece &rhs) const
+    {
+        return !(*this == rhs);
+    }
+
+private:
+    const char *ptr_;
+    size_t length_;
+};
+
+#endif
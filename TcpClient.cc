@@ -0,0 +1,155 @@
+#include "TcpClient.h"
+
+#include <stdio.h>
+#include <strings.h>
+
+#include "Logger.h"
+#include "EventLoop.h"
+#include "Slab.h"
+
+static EventLoop* CheckLoopNotNull(EventLoop *loop)
+{
+    if (loop == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d client loop is null! \n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return loop;
+}
+
+// TcpClient已经析构之后连接才断开时使用的关闭回调, 连接可能已经迁移到其他loop
+static void removeConnectionAfterClient(const TcpConnectionPtr &conn)
+{
+    conn->getLoop()->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+}
+
+TcpClient::TcpClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop))
+    , connector_(new Connector(loop, serverAddr))
+    , name_(nameArg)
+    , connectionCallback_()
+    , messageCallback_()
+    , retry_(false)
+    , connect_(false)
+    , edgeTriggered_(false)
+    , completionMode_(false)
+    , nextConnId_(1)
+{
+    connector_->setNewConnectionCallback(std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
+    LOG_INFO("TcpClient::TcpClient[%s] - connector %p \n", name_.c_str(), connector_.get());
+}
+
+TcpClient::~TcpClient()
+{
+    LOG_INFO("TcpClient::~TcpClient[%s] - connector %p \n", name_.c_str(), connector_.get());
+    TcpConnectionPtr conn;
+    bool unique = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        unique = connection_.use_count() == 1;
+        conn = connection_;
+    }
+
+    if (conn)
+    {
+        // 连接的关闭回调绑定了this, 换成不依赖TcpClient的版本
+        CloseCallback cb = removeConnectionAfterClient;
+        conn->getLoop()->runInLoop(std::bind(&TcpConnection::setCloseCallback, conn, cb));
+        if (unique)
+        {
+            conn->forceClose();
+        }
+    }
+    // 取消还没完成的连接尝试和等待中的重试
+    connector_->stop();
+}
+
+void TcpClient::connect()
+{
+    LOG_INFO("TcpClient::connect[%s] - connecting to %s \n",
+        name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+    connect_ = true;
+    connector_->start();
+}
+
+void TcpClient::disconnect()
+{
+    connect_ = false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (connection_)
+    {
+        connection_->shutdown();
+    }
+}
+
+void TcpClient::stop()
+{
+    connect_ = false;
+    connector_->stop();
+}
+
+// Connector连接成功之后在loop线程中调用
+void TcpClient::newConnection(int sockfd)
+{
+    sockaddr_in peer;
+    ::bzero(&peer, sizeof peer);
+    socklen_t addrlen = sizeof peer;
+    if (::getpeername(sockfd, (sockaddr*)&peer, &addrlen) < 0)
+    {
+        LOG_ERROR("sockets::getPeerAddr");
+    }
+    InetAddress peerAddr(peer);
+
+    sockaddr_in local;
+    ::bzero(&local, sizeof local);
+    addrlen = sizeof local;
+    if (::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0)
+    {
+        LOG_ERROR("sockets::getLocalAddr");
+    }
+    InetAddress localAddr(local);
+
+    char buf[64] = { 0 };
+    snprintf(buf, sizeof buf, ":%s#%d", peerAddr.toIpPort().c_str(), nextConnId_);
+    ++nextConnId_;
+    std::string connName = name_ + buf;
+
+    // 和TcpServer一样, 连接对象从loop的内存池中分配
+    TcpConnectionPtr conn = std::allocate_shared<TcpConnection>(
+                            SlabAllocator<TcpConnection>(loop_->slab()),
+                            loop_,
+                            connName,
+                            sockfd,
+                            localAddr,
+                            peerAddr);
+
+    conn->setConnectionCallback(connectionCallback_);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setEdgeTriggered(edgeTriggered_);
+    conn->setCompletionMode(completionMode_);
+    conn->setCloseCallback(
+        std::bind(&TcpClient::removeConnection, this, std::placeholders::_1)
+    );
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connection_.reset();
+    }
+
+    // 连接可能已经迁移到了别的loop(TcpConnection::migrateTo), 在连接当前所属的loop中销毁
+    conn->getLoop()->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    if (retry_ && connect_)
+    {
+        LOG_INFO("TcpClient::removeConnection[%s] - reconnecting to %s \n",
+            name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+        loop_->runInLoop(std::bind(&Connector::restart, connector_));
+    }
+}
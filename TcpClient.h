@@ -0,0 +1,83 @@
+#ifndef _TCPCLIENT_H_
+#define _TCPCLIENT_H_
+
+#include <functional>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "InetAddress.h"
+#include "Connector.h"
+#include "TcpConnection.h"
+
+class EventLoop;
+
+/*
+ * 用户使用muduo编写客户端程序
+ * 一个TcpClient同一时刻最多持有一个连接, 连接的所有IO都在构造时传入的loop中进行
+ * 需要把大量客户端分散到多个IO线程时, 用EventLoopThreadPool::getNextLoop()为每个TcpClient选择loop
+ * connect/disconnect/stop可以在任意线程调用, 回调和TcpServer一样在loop线程中执行
+*/
+class TcpClient : noncopyable
+{
+public:
+    TcpClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg);
+    // 必须在loop线程或者loop结束之后析构
+    ~TcpClient();
+
+    void connect();
+    // 关闭已经建立的连接(半关闭, 等待输出缓冲区发完)
+    void disconnect();
+    // 停止正在进行的连接尝试和重试, 不影响已经建立的连接
+    void stop();
+
+    TcpConnectionPtr connection() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return connection_;
+    }
+
+    EventLoop* getLoop() const { return loop_; }
+    const std::string& name() const { return name_; }
+
+    // 已建立的连接断开后自动重连
+    bool retry() const { return retry_; }
+    void enableRetry() { retry_ = true; }
+
+    // 连接建立的统计(尝试次数、失败次数、建连耗时等), 可以在任意线程读取
+    Connector::Stats connectorStats() const { return connector_->stats(); }
+
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+
+    // 和TcpServer相同的连接选项, 在connect之前设置
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+    void setCompletionMode(bool on) { completionMode_ = on; }
+
+private:
+    void newConnection(int sockfd);
+    void removeConnection(const TcpConnectionPtr &conn);
+
+    EventLoop *loop_;
+    std::shared_ptr<Connector> connector_;
+    const std::string name_;
+
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+
+    std::atomic_bool retry_;
+    std::atomic_bool connect_;
+    bool edgeTriggered_;
+    bool completionMode_;
+    int nextConnId_;                    // 只在loop线程中使用
+
+    mutable std::mutex mutex_;
+    TcpConnectionPtr connection_;       // 受mutex_保护
+};
+
+#endif
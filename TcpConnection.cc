@@ -8,6 +8,11 @@
 #include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <string>
+#include <algorithm>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <linux/errqueue.h>
 
 #include "Logger.h"
 #include "Socket.h"
@@ -29,67 +34,338 @@ TcpConnection::TcpConnection(EventLoop *loop,
             const InetAddress& localAddr,
             const InetAddress& peerAddr)
     : loop_(CheckLoopNotNull(loop))
-    , name_(nameArg)
     , state_(kDisconnecting)
     , reading_(true)
-    , socket_(new Socket(sockfd))
-    , channel_(new Channel(loop, sockfd))
+    , completionMode_(false)
+    , readHint_(kMinReadHint)
+    , highWaterMark_(64*1024*1024)  // 64Mb
+    , bytesTransferred_(0)
+    , channel_(loop, sockfd)
+    , timeouts_()
+    , socket_(sockfd)
+    , name_(nameArg)
     , localAddr_(localAddr)
     , peerAddr_(peerAddr)
-    , highWaterMark_(64*1024*1024)  // 64Mb
+    , completionRequested_(false)
+    , uring_(nullptr)
+    , migrating_(false)
+    , enqueuing_(0)
 {
     // 下面给channel设置相应的回调函数, poller给channel通知感兴趣的事件发生, channel会回调相应的操作函数
-    channel_->setReadCallback(
-        std::bind(&TcpConnection::handleRead, this, std::placeholders::_1)
-    );
-
-    channel_->setWriteCallback(
-        std::bind(&TcpConnection::handleWrite, this)
-    );
-
-    channel_->setCloseCallback(
-        std::bind(&TcpConnection::handleClose, this)
-    );
-
-    channel_->setErrorCallback(
-        std::bind(&TcpConnection::handleError, this)
-    );
+    // 用只捕获this的lambda而不是std::bind: 成员函数指针加this超过了std::function的内联存储, bind每个回调都要分配一次内存
+    channel_.setReadCallback([this](Timestamp receiveTime) { handleRead(receiveTime); });
+    channel_.setWriteCallback([this] { handleWrite(); });
+    channel_.setCloseCallback([this] { handleClose(); });
+    channel_.setErrorCallback([this] { handleError(); });
 
     LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
-    socket_->setKeepAlive(true);
+    socket_.setKeepAlive(true);
+    // 在分配连接的线程中立即计入, 连续到来的连接能看到前面刚分配出去的连接
+    loop->connectionCreated();
 }
 
 TcpConnection::~TcpConnection()
 {
     LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d \n",
-        name_.c_str(), channel_->fd(), (int)state_);
+        name_.c_str(), channel_.fd(), (int)state_);
+}
+
+void TcpConnection::setEdgeTriggered(bool on)
+{
+    channel_.setEdgeTriggered(on);
+}
+
+void TcpConnection::setIdleTimeout(double seconds)
+{
+    runInOwnerLoop(std::bind(&TcpConnection::setTimeoutInLoop, shared_from_this(), kIdleTimeout, seconds));
+}
+
+void TcpConnection::setReadTimeout(double seconds)
+{
+    runInOwnerLoop(std::bind(&TcpConnection::setTimeoutInLoop, shared_from_this(), kReadTimeout, seconds));
+}
+
+void TcpConnection::setWriteTimeout(double seconds)
+{
+    runInOwnerLoop(std::bind(&TcpConnection::setTimeoutInLoop, shared_from_this(), kWriteTimeout, seconds));
+}
+
+void TcpConnection::setTimeoutInLoop(int which, double seconds)
+{
+    timeouts_[which] = seconds;
+    if (seconds <= 0)
+    {
+        cancelTimeout(which);
+        return;
+    }
+
+    // 回调只在第一次开启超时的时候设置
+    TimingWheel::Entry &entry = timeoutEntries_[which];
+    if (!entry.scheduled())
+    {
+        entry.setCallback(std::bind(&TcpConnection::handleTimeout, this, which));
+    }
+
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        // 写超时只在有待发送数据的时候计时
+        if (which != kWriteTimeout || outputBuffer_.readableBytes() > 0)
+        {
+            refreshTimeout(which);
+        }
+    }
+}
+
+void TcpConnection::refreshTimeout(int which)
+{
+    if (timeouts_[which] > 0)
+    {
+        loop()->timingWheel()->schedule(&timeoutEntries_[which], timeouts_[which]);
+    }
+}
+
+void TcpConnection::cancelTimeout(int which)
+{
+    if (timeoutEntries_[which].scheduled())
+    {
+        loop()->timingWheel()->cancel(&timeoutEntries_[which]);
+    }
+}
+
+void TcpConnection::cancelAllTimeouts()
+{
+    for (int i = 0; i < kNumTimeouts; ++i)
+    {
+        cancelTimeout(i);
+    }
+}
+
+// 超时的连接和对端关闭一样, 走handleClose, 由TcpServer回收
+void TcpConnection::handleTimeout(int which)
+{
+    static const char *names[kNumTimeouts] = { "idle", "read", "write" };
+    LOG_INFO("TcpConnection::handleTimeout [%s] - %s timeout after %.1fs \n",
+        name_.c_str(), names[which], timeouts_[which]);
+
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        handleClose();
+    }
 }
 
 void TcpConnection::send(const std::string &buf)
 {
     if (state_ == kConnected)
     {
-        if (loop_->isInLoopThread())
+        if (isInOwnerLoop())
         {
-            sendInLoop(buf.c_str(), buf.size());
+            sendInLoop(buf.data(), buf.size(), nullptr);
         }
         else
         {
-            loop_->runInLoop(std::bind(
-                &TcpConnection::sendInLoop, 
-                this,
-                buf.c_str(),
-                buf.size()
+            // 跨线程时不能引用调用方的buf, 拷贝一份之后转移所有权
+            send(std::string(buf));
+        }
+    }
+}
+
+void TcpConnection::send(std::string &&buf)
+{
+    if (state_ == kConnected)
+    {
+        if (isInOwnerLoop() && buf.size() < kMinBlockSize)
+        {
+            sendInLoop(buf.data(), buf.size(), nullptr);
+        }
+        else
+        {
+            std::shared_ptr<std::string> holder = std::make_shared<std::string>(std::move(buf));
+            send(holder->data(), holder->size(), holder);
+        }
+    }
+}
+
+void TcpConnection::send(Buffer *buf)
+{
+    if (state_ == kConnected)
+    {
+        if (isInOwnerLoop() && buf->readableBytes() < kMinBlockSize)
+        {
+            sendInLoop(buf->peek(), buf->readableBytes(), nullptr);
+            buf->retrieveAll();
+        }
+        else
+        {
+            // 把buf的存储换出来, 调用方拿到一个新的空Buffer
+            std::shared_ptr<Buffer> holder = std::make_shared<Buffer>();
+            holder->swap(*buf);
+            send(holder->peek(), holder->readableBytes(), holder);
+        }
+    }
+}
+
+void TcpConnection::send(const std::shared_ptr<const std::string> &message)
+{
+    send(message->data(), message->size(), message);
+}
+
+void TcpConnection::send(const BufferSlice &slice)
+{
+    send(slice.data(), slice.size(), slice.storage());
+}
+
+void TcpConnection::send(const void *data, size_t len, const std::shared_ptr<const void> &holder)
+{
+    if (state_ == kConnected)
+    {
+        if (isInOwnerLoop())
+        {
+            sendInLoop(data, len, holder);
+        }
+        else if (!holder)
+        {
+            // 没有holder时跨线程不能引用调用方的数据, 拷贝一份
+            send(std::string(static_cast<const char*>(data), len));
+        }
+        else
+        {
+            queueInOwnerLoop(std::bind(
+                &TcpConnection::sendInLoop,
+                shared_from_this(),
+                data,
+                len,
+                holder
             ));
         }
     }
 }
 
+void TcpConnection::sendv(const struct iovec *iov, int iovcnt)
+{
+    if (state_ == kConnected)
+    {
+        if (isInOwnerLoop())
+        {
+            sendvInLoop(iov, iovcnt, nullptr);
+        }
+        else
+        {
+            // 跨线程时把各段数据合并成一个string再转移所有权
+            size_t total = 0;
+            for (int i = 0; i < iovcnt; ++i)
+            {
+                total += iov[i].iov_len;
+            }
+            std::string buf;
+            buf.reserve(total);
+            for (int i = 0; i < iovcnt; ++i)
+            {
+                buf.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+            }
+            send(std::move(buf));
+        }
+    }
+}
+
+void TcpConnection::sendFile(int fd, off_t offset, size_t len)
+{
+    if (state_ == kConnected)
+    {
+        // dup一份, 调用方可以立即关闭自己的fd, 这份在发送完之后由outputBuffer_关闭
+        int filefd = ::dup(fd);
+        if (filefd < 0)
+        {
+            LOG_ERROR("TcpConnection::sendFile dup err:%d \n", errno);
+            return;
+        }
+        if (isInOwnerLoop())
+        {
+            sendFileInLoop(filefd, offset, len);
+        }
+        else
+        {
+            queueInOwnerLoop(std::bind(
+                &TcpConnection::sendFileInLoop,
+                shared_from_this(),
+                filefd,
+                offset,
+                len
+            ));
+        }
+    }
+}
+
+// 文件排在已有数据的后面, 由EPOLLOUT驱动sendfile发送
+void TcpConnection::setZeroCopy(bool on, size_t threshold)
+{
+    runInOwnerLoop(std::bind(&TcpConnection::setZeroCopyInLoop, shared_from_this(), on, threshold));
+}
+
+void TcpConnection::setZeroCopyInLoop(bool on, size_t threshold)
+{
+    if (on && !socket_.setZeroCopy(true))
+    {
+        LOG_ERROR("TcpConnection::setZeroCopy [%s] SO_ZEROCOPY not supported:%d \n", name_.c_str(), errno);
+        on = false;
+    }
+    outputBuffer_.setZeroCopyThreshold(on ? threshold : 0);
+    if (completionMode_)
+    {
+        uringState_->zeroCopy = on && uring_->opSupported(IORING_OP_SENDMSG_ZC);
+    }
+}
+
+void TcpConnection::sendFileInLoop(int fd, off_t offset, size_t len)
+{
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing!");
+        ::close(fd);
+        return;
+    }
+
+    size_t oldLen = outputBuffer_.readableBytes();
+    if (oldLen + len >= highWaterMark_
+            && oldLen < highWaterMark_
+            && highWaterMarkCallback_)
+    {
+        queueInOwnerLoop(
+            std::bind(highWaterMarkCallback_, shared_from_this(), oldLen+len)
+        );
+    }
+    outputBuffer_.appendFile(fd, offset, len);
+
+    if (completionMode_)
+    {
+        if (uringState_->sendOp.inflight == 0)
+        {
+            submitSend();
+        }
+    }
+    else if (!channel_.isWriting())
+    {
+        channel_.enableWriting();
+    }
+    if (!timeoutEntries_[kWriteTimeout].scheduled())
+    {
+        refreshTimeout(kWriteTimeout);
+    }
+}
+
+void TcpConnection::sendInLoop(const void* data, size_t len, const std::shared_ptr<const void> &holder)
+{
+    struct iovec vec;
+    vec.iov_base = const_cast<void*>(data);
+    vec.iov_len = len;
+    sendvInLoop(&vec, 1, holder);
+}
+
 // 发送数据, 应用写的快, 而内核发送数据慢, 需要把待发送数据写入缓冲区, 而且设置了水位回调
-void TcpConnection::sendInLoop(const void* data, size_t len)
+// holder不为空时, 没发完的数据直接引用, 不拷贝
+void TcpConnection::sendvInLoop(const struct iovec *iov, int iovcnt, const std::shared_ptr<const void> &holder)
 {
     ssize_t nwrote = 0;
-    size_t remaining = len;
+    size_t len = 0;
     bool faultError = false;
 
     // 调用过该connection的shutdown, 不能再进行发送了
@@ -99,17 +375,29 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
         return;
     }
 
+    for (int i = 0; i < iovcnt; ++i)
+    {
+        len += iov[i].iov_len;
+    }
+    size_t remaining = len;
+
     // 表示channel_ 第一次开始写数据, 而且缓冲区没有待发送数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+    // 完成模式下不直接写, 数据都先进入outputBuffer_, 在下一次poll时和其他提交项一起交给内核
+    // 可以zerocopy的大块数据不直接写, 进入outputBuffer_之后由handleWrite用MSG_ZEROCOPY发送
+    bool zeroCopy = holder && outputBuffer_.zeroCopyThreshold() > 0 && len >= outputBuffer_.zeroCopyThreshold();
+    if (!completionMode_ && !zeroCopy && !channel_.isWriting() && outputBuffer_.readableBytes() == 0)
     {
-        nwrote = ::write(channel_->fd(), data, len);
+        nwrote = iovcnt == 1 ? ::write(channel_.fd(), iov[0].iov_base, iov[0].iov_len)
+                             : ::writev(channel_.fd(), iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX);
         if (nwrote >= 0)
         {
+            addBytesTransferred(nwrote);
+            refreshTimeout(kIdleTimeout);
             remaining = len - nwrote;
             if (remaining == 0 && writeCompleteCallback_)
             {
                 // 数据一次性全部发送完成, 就不用再给channel设置epollout事件了
-                loop_->queueInLoop(
+                queueInOwnerLoop(
                     std::bind(writeCompleteCallback_, shared_from_this())
                 );
             }
@@ -139,14 +427,50 @@ void TcpConnection::sendInLoop(const void* data, size_t len)
                 && oldLen < highWaterMark_
                 && highWaterMarkCallback_)
         {
-            loop_->queueInLoop(
+            queueInOwnerLoop(
                 std::bind(highWaterMarkCallback_, shared_from_this(), oldLen+remaining)
             );
         }
-        outputBuffer_.append((char*)data + nwrote, remaining);
-        if (!channel_->isWriting())
+
+        // 跳过已经写出去的部分, 剩下的小段拷贝进chunk, 有holder的大段直接引用
+        size_t skip = nwrote;
+        for (int i = 0; i < iovcnt; ++i)
+        {
+            const char *base = static_cast<const char*>(iov[i].iov_base);
+            size_t n = iov[i].iov_len;
+            if (skip >= n)
+            {
+                skip -= n;
+                continue;
+            }
+            base += skip;
+            n -= skip;
+            skip = 0;
+            if (holder && (n >= kMinBlockSize || zeroCopy))
+            {
+                outputBuffer_.appendBlock(base, n, holder);
+            }
+            else
+            {
+                outputBuffer_.append(base, n);
+            }
+        }
+
+        if (completionMode_)
+        {
+            if (uringState_->sendOp.inflight == 0)
+            {
+                submitSend();
+            }
+        }
+        else if (!channel_.isWriting())
+        {
+            channel_.enableWriting();      // 这里一定要注册channel的写事件, 否则poller不会给channel通知epollout
+        }
+        // 开始等待发送, 已经在计时的话不刷新, 只有发送进展才刷新写超时
+        if (!timeoutEntries_[kWriteTimeout].scheduled())
         {
-            channel_->enableWriting();      // 这里一定要注册channel的写事件, 否则poller不会给channel通知epollout
+            refreshTimeout(kWriteTimeout);
         }
     }
 }
@@ -157,7 +481,7 @@ void TcpConnection::shutdown()
     if (state_ == kConnected)
     {
         setState(kDisconnecting);
-        loop_->runInLoop(
+        runInOwnerLoop(
             std::bind(&TcpConnection::shutdownInLoop, this)
         );
     }
@@ -165,9 +489,38 @@ void TcpConnection::shutdown()
 
 void TcpConnection::shutdownInLoop()
 {
-    if (!channel_->isWriting())     // 说明outputBuffer中的数据已经发送完成了
+    if (completionMode_)
     {
-        socket_->shutdownWrite();   // 关闭写端
+        // 有在途的send时, 等send完成之后再关闭写端
+        if (uringState_->sendOp.inflight == 0)
+        {
+            socket_.shutdownWrite();
+        }
+        return;
+    }
+
+    if (!channel_.isWriting())     // 说明outputBuffer中的数据已经发送完成了
+    {
+        socket_.shutdownWrite();   // 关闭写端
+    }
+}
+
+void TcpConnection::forceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        setState(kDisconnecting);
+        queueInOwnerLoop(
+            std::bind(&TcpConnection::forceCloseInLoop, shared_from_this())
+        );
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        handleClose();      // 和对端关闭的处理一样
     }
 }
 
@@ -175,8 +528,25 @@ void TcpConnection::shutdownInLoop()
 void TcpConnection::connectEstablished()
 {
     setState(kConnected);
-    channel_->tie(shared_from_this());
-    channel_->enableReading();              // 向poller注册channel的epollin事件
+    channel_.tie(shared_from_this());
+
+    uring_ = loop()->ioUringPoller();
+    completionMode_ = completionRequested_ && uring_ != nullptr && uring_->completionSupported();
+    if (completionMode_)
+    {
+        uringState_.reset(new CompletionState);
+        uringState_->recvOp.handler = std::bind(&TcpConnection::handleRecvComplete, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+        uringState_->sendOp.handler = std::bind(&TcpConnection::handleSendComplete, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+        uringState_->shutdownOp.handler = std::bind(&TcpConnection::handleShutdownComplete, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
+        startRecv();                        // 完成模式不向poller注册channel
+    }
+    else
+    {
+        channel_.enableReading();          // 向poller注册channel的epollin事件
+    }
 
     // 新连接建立, 执行回调
     connectionCallback_(shared_from_this());
@@ -188,88 +558,675 @@ void TcpConnection::connectDestroyed()
     if (state_ == kConnected)
     {
         setState(kDisconnected);
-        channel_->disableAll();             // 把channel所有感兴趣的事件, 从poller中del掉
+        if (!completionMode_)
+        {
+            channel_.disableAll();         // 把channel所有感兴趣的事件, 从poller中del掉
+        }
         connectionCallback_(shared_from_this());
     }
 
-    channel_->remove();                     // 把channel从poller中删除掉
+    cancelAllTimeouts();
+    loop()->connectionDestroyed();
+    if (completionMode_)
+    {
+        uring_->cancelOp(&uringState_->recvOp);
+        uring_->cancelOp(&uringState_->sendOp);
+    }
+    else
+    {
+        channel_.remove();                 // 把channel从poller中删除掉
+    }
 }
 
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
+    // ET模式的续读是通过queueInLoop投递的, 执行时连接可能已经关闭, 或者读写已经被takeOverIo接管
+    if (state_ == kDisconnected || !reading_)
+    {
+        return;
+    }
+
+    /*
+     * LT模式每次事件只读一次, 没读完的数据poller会再次通知
+     * ET模式一直读到EAGAIN为止, 但最多读kMaxDrainPerEvent次, 预算用完后把剩下的读取放到下一轮loop,
+     * 避免一个繁忙的连接饿死同一个loop上的其他连接
+    */
+    const int maxReads = channel_.edgeTriggered() ? kMaxDrainPerEvent : 1;
+    // 没有残留数据时读到loop共享的缓冲区, 空闲连接的inputBuffer_不占内存
+    Buffer *buf = inputBuffer_.readableBytes() > 0 ? &inputBuffer_ : loop()->readBuffer();
     int saveErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &saveErrno);
-    if (n > 0)
+    int reads = 0;
+    ssize_t total = 0;
+    ssize_t n = 0;
+    while (reads < maxReads)
     {
+        // 大块传输时提前留够空间, 数据直接读进buf, 不经过readFd的额外空间再拷贝一次
+        buf->ensureWritableBytes(readHint_);
+        const size_t writable = buf->writableBytes();
+        n = buf->readFd(channel_.fd(), &saveErrno);
+        ++reads;
+        if (n <= 0)
+        {
+            break;
+        }
+        total += n;
+        adjustReadHint(n, writable);
+    }
+
+    if (total > 0)
+    {
+        addBytesTransferred(total);
+        refreshTimeout(kIdleTimeout);
+        refreshTimeout(kReadTimeout);
         // 已建立连接的用户, 有可读的事件发生了, 调用用户传入的回调操作onMessage
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        deliverMessage(buf, receiveTime);
     }
-    else if (n == 0)
+
+    if (n == 0)
     {
         handleClose();
     }
-    else
+    else if (n < 0)
     {
-        errno = saveErrno;
-        LOG_ERROR("TcpConnection::handleRead");
-        handleError();
+        if (saveErrno != EAGAIN && saveErrno != EWOULDBLOCK)
+        {
+            errno = saveErrno;
+            LOG_ERROR("TcpConnection::handleRead");
+            handleError();
+        }
+    }
+    else if (channel_.edgeTriggered() && state_ != kDisconnected)
+    {
+        // 预算用完了, socket中可能还有数据, ET模式不会再通知, 下一轮loop继续读
+        queueInOwnerLoop(
+            std::bind(&TcpConnection::handleRead, shared_from_this(), receiveTime)
+        );
+    }
+}
+
+/*
+ * 一次读取溢出到了额外空间, 说明数据量大, 读取大小翻倍(不超过额外空间的大小)
+ * 读到的数据远小于读取大小时减半, 小请求只会用到共享缓冲区开头已经在缓存里的内存
+*/
+void TcpConnection::adjustReadHint(ssize_t n, size_t writable)
+{
+    if (static_cast<size_t>(n) > writable)
+    {
+        readHint_ = std::min(std::max(readHint_ * 2, static_cast<size_t>(n)), Buffer::extraBufferSize());
+    }
+    else if (static_cast<size_t>(n) < readHint_ / 4 && readHint_ > kMinReadHint)
+    {
+        readHint_ /= 2;
+    }
+}
+
+// buf是loop共享的读缓冲区时, 用户没有取走的数据(不完整的消息)拷贝进inputBuffer_保留, 然后清空共享缓冲区
+// inputBuffer_被读空之后把存储还给系统
+void TcpConnection::deliverMessage(Buffer *buf, Timestamp receiveTime)
+{
+    messageCallback_(shared_from_this(), buf, receiveTime);
+    if (buf != &inputBuffer_)
+    {
+        if (buf->readableBytes() > 0)
+        {
+            inputBuffer_.append(buf->peek(), buf->readableBytes());
+        }
+        buf->retrieveAll();
+    }
+    else if (inputBuffer_.readableBytes() == 0)
+    {
+        inputBuffer_.shrink(0);
     }
 }
 
 void TcpConnection::handleWrite()
 {
-    if (channel_->isWriting())
+    if (channel_.isWriting())
     {
+        // 和handleRead一样, ET模式写到EAGAIN或者数据写完为止, 最多kMaxDrainPerEvent次
+        const int maxWrites = channel_.edgeTriggered() ? kMaxDrainPerEvent : 1;
         int saveErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &saveErrno);
-        if (n > 0)
+        for (int writes = 0; writes < maxWrites; ++writes)
         {
-            outputBuffer_.retrieve(n);
-            if (outputBuffer_.readableBytes() == 0)
+            ssize_t n = outputBuffer_.writeFd(channel_.fd(), &saveErrno);
+            if (n > 0)
             {
-                channel_->disableWriting();
-                if (writeCompleteCallback_)
+                outputBuffer_.retrieve(n);
+                addBytesTransferred(n);
+                refreshTimeout(kIdleTimeout);
+                if (outputBuffer_.readableBytes() == 0)
                 {
-                    // 唤醒loop_ 对应的thread线程, 执行回调
-                    loop_->queueInLoop(
-                        std::bind(writeCompleteCallback_, shared_from_this())
-                    );
+                    cancelTimeout(kWriteTimeout);
+                    channel_.disableWriting();
+                    if (writeCompleteCallback_)
+                    {
+                        // 唤醒loop_ 对应的thread线程, 执行回调
+                        queueInOwnerLoop(
+                            std::bind(writeCompleteCallback_, shared_from_this())
+                        );
+                    }
+                    if (state_ == kDisconnecting)
+                    {
+                        shutdownInLoop();
+                    }
+                    return;
                 }
-                if (state_ == kDisconnecting)
+                refreshTimeout(kWriteTimeout);
+            }
+            else
+            {
+                if (saveErrno != EAGAIN && saveErrno != EWOULDBLOCK)
                 {
-                    shutdownInLoop();
+                    LOG_ERROR("TcpConnection::handleWrite");
+                    if (saveErrno == EIO)
+                    {
+                        // sendFile的文件被截断了, 对端收到的数据已经不完整, 直接关闭连接
+                        handleClose();
+                    }
                 }
+                return;
             }
         }
-        else
+
+        if (channel_.edgeTriggered())
         {
-            LOG_ERROR("TcpConnection::handleWrite");
+            // 预算用完了, socket仍然可写, ET模式不会再有EPOLLOUT通知, 下一轮loop继续写
+            queueInOwnerLoop(
+                std::bind(&TcpConnection::handleWrite, shared_from_this())
+            );
         }
     }
     else
     {
-        LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_->fd());
+        LOG_ERROR("TcpConnection fd=%d is down, no more writing \n", channel_.fd());
+    }
+}
+
+bool TcpConnection::takeOverIo(const Channel::ReadEventCallback &onReadable,
+                                const Channel::EventCallback &onWritable,
+                                const Channel::EventCallback &onClose,
+                                Buffer *leftover)
+{
+    if (!isInOwnerLoop() || state_ != kConnected || completionMode_
+        || outputBuffer_.readableBytes() > 0)
+    {
+        LOG_ERROR("TcpConnection::takeOverIo [%s] - connection is not idle in readiness mode \n", name_.c_str());
+        return false;
+    }
+    cancelAllTimeouts();
+    reading_ = false;                   // TcpConnection自己不再读socket
+    leftover->swap(inputBuffer_);
+    ioCloseCallback_ = onClose;
+    channel_.setReadCallback(onReadable);
+    channel_.setWriteCallback(onWritable);
+    return true;
+}
+
+void TcpConnection::setIoInterest(bool reading, bool writing)
+{
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    if (reading != channel_.isReading())
+    {
+        reading ? channel_.enableReading() : channel_.disableReading();
+    }
+    if (writing != channel_.isWriting())
+    {
+        writing ? channel_.enableWriting() : channel_.disableWriting();
+    }
+}
+
+bool TcpConnection::isInOwnerLoop() const
+{
+    // 先读loop_: 看到迁移后的新loop时一定也能看到migrating_被置为true
+    return loop_.load(std::memory_order_acquire)->isInLoopThread()
+        && !migrating_.load(std::memory_order_relaxed);
+}
+
+void TcpConnection::runInOwnerLoop(Functor cb)
+{
+    if (isInOwnerLoop())
+    {
+        cb();
+    }
+    else
+    {
+        queueInOwnerLoop(std::move(cb));
+    }
+}
+
+void TcpConnection::queueInOwnerLoop(Functor cb)
+{
+    // 迁移只能由所属loop线程开始, 这个线程看到没有迁移时不会和迁移并发, 不需要加锁
+    if (isInOwnerLoop())
+    {
+        loop()->queueInLoop(std::move(cb));
+        return;
+    }
+    // 没有迁移时不加锁: 先登记再检查migrating_, 和migrateInLoop先置位再检查登记数相对,
+    // 两边至少有一边能看到对方, 看到migrating_为false的调用一定排在detach之前(见detachInLoop)
+    enqueuing_.fetch_add(1);
+    if (!migrating_.load())
+    {
+        loop()->queueInLoop(std::move(cb));
+        enqueuing_.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+    enqueuing_.fetch_sub(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(migrateMutex_);
+    if (migrating_)
+    {
+        migratePending_.push_back(std::move(cb));
+    }
+    else
+    {
+        loop()->queueInLoop(std::move(cb));
+    }
+}
+
+void TcpConnection::migrateTo(EventLoop *target)
+{
+    runInOwnerLoop(std::bind(&TcpConnection::migrateInLoop, shared_from_this(), target));
+}
+
+/*
+ * 迁移分两步, 都在原loop中执行:
+ * 1. 置migrating_, 之后其他线程的调用都暂存到migratePending_, 不再进入原loop的任务队列
+ * 2. 等没加锁的投递都结束后再排一次队, 原loop任务队列中在第1步之前投递的调用都执行完之后(任务队列先进先出),
+ *    摘下channel并切换loop_
+ * 新loop中先重新注册channel, 再按顺序执行暂存的调用
+*/
+void TcpConnection::migrateInLoop(EventLoop *target)
+{
+    // 上一次迁移还没结束时(在新loop执行暂存的调用期间)忽略
+    if (target == loop() || migrating_)
+    {
+        return;
+    }
+    if (state_ != kConnected || completionMode_ || ioCloseCallback_)
+    {
+        LOG_ERROR("TcpConnection::migrateTo [%s] - only established connections in readiness mode can migrate \n",
+            name_.c_str());
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(migrateMutex_);
+        migrating_ = true;
+    }
+    loop()->queueInLoop(std::bind(&TcpConnection::detachInLoop, shared_from_this(), target, false));
+}
+
+void TcpConnection::detachInLoop(EventLoop *target, bool drained)
+{
+    EventLoop *source = loop();
+    if (!drained)
+    {
+        // 还有线程在置位之前看到migrating_为false, 正在投递, 等它投递完
+        // 登记数为0时这些调用都已经进入任务队列, 但可能排在本次detach之后, 所以再排一次队
+        const bool busy = enqueuing_.load() != 0;
+        source->queueInLoop(std::bind(&TcpConnection::detachInLoop, shared_from_this(), target, !busy));
+        return;
+    }
+    if (state_ != kConnected)
+    {
+        // 迁移之前连接已经关闭了, 暂存的调用留在原loop执行
+        std::vector<Functor> pending;
+        {
+            std::lock_guard<std::mutex> lock(migrateMutex_);
+            migrating_ = false;
+            pending.swap(migratePending_);
+        }
+        for (const Functor &cb : pending)
+        {
+            cb();
+        }
+        return;
+    }
+
+    const bool reading = channel_.isReading();
+    const bool writing = channel_.isWriting();
+    channel_.disableAll();
+    channel_.remove();
+    cancelAllTimeouts();                // timeouts_保留, 在新loop中重新计时
+    channel_.setOwnerLoop(target);
+    source->connectionDestroyed();
+    target->connectionCreated();
+    {
+        std::lock_guard<std::mutex> lock(migrateMutex_);
+        loop_.store(target, std::memory_order_release);
+    }
+    LOG_INFO("TcpConnection::migrateTo [%s] - fd=%d moved to another loop \n", name_.c_str(), channel_.fd());
+    target->queueInLoop(std::bind(&TcpConnection::attachInLoop, shared_from_this(), reading, writing));
+}
+
+void TcpConnection::attachInLoop(bool reading, bool writing)
+{
+    // 重新注册时epoll会报告socket当前的状态, ET模式下迁移期间到达的数据也不会丢失通知
+    if (reading)
+    {
+        channel_.enableReading();
+    }
+    if (writing)
+    {
+        channel_.enableWriting();
+    }
+    for (int i = 0; i < kNumTimeouts; ++i)
+    {
+        if (timeouts_[i] > 0)
+        {
+            setTimeoutInLoop(i, timeouts_[i]);
+        }
+    }
+
+    // 执行暂存的调用, 执行期间新的调用继续暂存, 直到队列为空才结束迁移
+    for (;;)
+    {
+        std::vector<Functor> pending;
+        {
+            std::lock_guard<std::mutex> lock(migrateMutex_);
+            if (migratePending_.empty())
+            {
+                migrating_ = false;
+                break;
+            }
+            pending.swap(migratePending_);
+        }
+        for (const Functor &cb : pending)
+        {
+            cb();
+        }
     }
 }
 
 // poller => channel::closeCallback => TcpConnection::handleClose
 void TcpConnection::handleClose()
 {
-    LOG_INFO("fd=%d state=%d \n", channel_->fd(), (int)state_);
+    LOG_INFO("fd=%d state=%d \n", channel_.fd(), (int)state_);
     setState(kDisconnected);
-    channel_->disableAll();
+    if (completionMode_)
+    {
+        // 在途的操作完成(或被取消)之前, op持有的guard保证连接不会析构
+        uring_->cancelOp(&uringState_->recvOp);
+        uring_->cancelOp(&uringState_->sendOp);
+    }
+    else
+    {
+        channel_.disableAll();
+    }
+    cancelAllTimeouts();
 
     TcpConnectionPtr connPtr(shared_from_this());
+    if (ioCloseCallback_)
+    {
+        ioCloseCallback_();
+    }
     connectionCallback_(connPtr);       // 执行连接关闭的回调
     closeCallback_(connPtr);            // 关闭连接的回调  执行的是TcpServer::removeConnection回调方法
 }
 
+void TcpConnection::startRecv()
+{
+    IoUringBufferRing *bufRing = uring_->bufferRing();
+    io_uring_sqe *sqe = uring_->prepareOp(&uringState_->recvOp, shared_from_this());
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = socket_.fd();
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bufRing->groupId();
+}
+
+/*
+ * 用outputBuffer_前面的节点提交sendmsg, 已经进入outputBuffer_的数据不会移动, 在途期间可以继续追加
+ * 关闭中的连接在最后一次send之后链接一个shutdown
+*/
+void TcpConnection::submitSend()
+{
+    // io_uring没有sendfile, 排在前面的是文件时等POLLOUT, 完成之后在loop线程中sendfile
+    if (outputBuffer_.frontIsFile())
+    {
+        io_uring_sqe *sqe = uring_->prepareOp(&uringState_->sendOp, shared_from_this());
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = socket_.fd();
+        sqe->poll32_events = POLLOUT;
+        uringState_->sendPolling = true;
+        return;
+    }
+
+    if (uringState_->sendIov.empty())
+    {
+        uringState_->sendIov.resize(IOV_MAX);
+    }
+    int iovcnt = outputBuffer_.fillIovec(&*uringState_->sendIov.begin(), IOV_MAX);
+    size_t bytes = 0;
+    for (int i = 0; i < iovcnt; ++i)
+    {
+        bytes += uringState_->sendIov[i].iov_len;
+    }
+
+    bzero(&uringState_->sendMsg, sizeof uringState_->sendMsg);
+    uringState_->sendMsg.msg_iov = &*uringState_->sendIov.begin();
+    uringState_->sendMsg.msg_iovlen = iovcnt;
+
+    io_uring_sqe *sqe = uring_->prepareOp(&uringState_->sendOp, shared_from_this());
+    // SENDMSG_ZC的数据在通知到达之前不会retrieve, 期间也不会提交下一次send
+    bool zeroCopy = uringState_->zeroCopy && bytes >= outputBuffer_.zeroCopyThreshold();
+    sqe->opcode = zeroCopy ? IORING_OP_SENDMSG_ZC : IORING_OP_SENDMSG;
+    sqe->fd = socket_.fd();
+    sqe->addr = reinterpret_cast<uint64_t>(&uringState_->sendMsg);
+    sqe->len = 1;
+    // MSG_WAITALL让内核在短写时自己重试, 短写会中断后面链接的shutdown
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+
+    if (state_ == kDisconnecting && bytes == outputBuffer_.readableBytes() && !uringState_->shutdownLinked)
+    {
+        sqe->flags |= IOSQE_IO_LINK;
+        io_uring_sqe *shut = uring_->prepareOp(&uringState_->shutdownOp, shared_from_this());
+        shut->opcode = IORING_OP_SHUTDOWN;
+        shut->fd = socket_.fd();
+        shut->len = SHUT_WR;
+        uringState_->shutdownLinked = true;
+    }
+}
+
+void TcpConnection::handleRecvComplete(int res, unsigned flags, Timestamp receiveTime)
+{
+    if (res > 0)
+    {
+        // 数据拷贝出来之后立即把缓冲区还给内核
+        IoUringBufferRing *bufRing = uring_->bufferRing();
+        int bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        if (state_ == kDisconnected)
+        {
+            bufRing->recycle(bid);
+            return;
+        }
+        Buffer *buf = inputBuffer_.readableBytes() > 0 ? &inputBuffer_ : loop()->readBuffer();
+        buf->append(bufRing->buffer(bid), res);
+        bufRing->recycle(bid);
+        addBytesTransferred(res);
+
+        refreshTimeout(kIdleTimeout);
+        refreshTimeout(kReadTimeout);
+        deliverMessage(buf, receiveTime);
+    }
+    else if (res == 0)
+    {
+        if (state_ != kDisconnected)
+        {
+            handleClose();
+        }
+        return;
+    }
+    else if (res == -ECANCELED)
+    {
+        return;
+    }
+    else if (res != -ENOBUFS)
+    {
+        // 缓冲区组暂时用完(ENOBUFS)时multishot会结束, 下面重新提交即可, 其他错误按对端关闭处理
+        if (state_ != kDisconnected)
+        {
+            errno = -res;
+            LOG_ERROR("TcpConnection::handleRecvComplete [%s] err:%d \n", name_.c_str(), -res);
+            handleClose();
+        }
+        return;
+    }
+
+    // multishot recv结束了, 连接还在就重新提交
+    if (!(flags & IORING_CQE_F_MORE) && state_ != kDisconnected)
+    {
+        startRecv();
+    }
+}
+
+void TcpConnection::handleSendComplete(int res, unsigned flags, Timestamp /*receiveTime*/)
+{
+    if (flags & IORING_CQE_F_MORE)
+    {
+        // SENDMSG_ZC的发送结果, 内核还引用着数据, 等通知到了再retrieve
+        uringState_->zeroCopySent = res;
+        return;
+    }
+    if (flags & IORING_CQE_F_NOTIF)
+    {
+        res = uringState_->zeroCopySent;
+        uringState_->zeroCopySent = 0;
+    }
+
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    if (res < 0)
+    {
+        if (res != -ECANCELED)
+        {
+            errno = -res;
+            LOG_ERROR("TcpConnection::handleSendComplete [%s] err:%d \n", name_.c_str(), -res);
+        }
+        return;
+    }
+
+    if (uringState_->sendPolling)
+    {
+        // socket可写了, 发送排在前面的文件
+        uringState_->sendPolling = false;
+        int saveErrno = 0;
+        ssize_t n = outputBuffer_.writeFd(socket_.fd(), &saveErrno);
+        if (n < 0)
+        {
+            if (saveErrno == EAGAIN || saveErrno == EWOULDBLOCK)
+            {
+                submitSend();
+            }
+            else
+            {
+                errno = saveErrno;
+                LOG_ERROR("TcpConnection::handleSendComplete [%s] sendfile err:%d \n", name_.c_str(), saveErrno);
+                if (saveErrno == EIO)
+                {
+                    handleClose();
+                }
+            }
+            return;
+        }
+        res = static_cast<int>(n);
+    }
+
+    outputBuffer_.retrieve(res);
+    addBytesTransferred(res);
+    refreshTimeout(kIdleTimeout);
+    if (outputBuffer_.readableBytes() == 0)
+    {
+        cancelTimeout(kWriteTimeout);
+        if (writeCompleteCallback_)
+        {
+            queueInOwnerLoop(
+                std::bind(writeCompleteCallback_, shared_from_this())
+            );
+        }
+        // 没有链接shutdown的话在这里关闭写端
+        if (state_ == kDisconnecting && !uringState_->shutdownLinked)
+        {
+            socket_.shutdownWrite();
+        }
+    }
+    else
+    {
+        refreshTimeout(kWriteTimeout);
+        // 短写中断了链接的shutdown, 剩余数据重新提交时再链接一次
+        uringState_->shutdownLinked = false;
+        submitSend();
+    }
+}
+
+void TcpConnection::handleShutdownComplete(int res, unsigned /*flags*/, Timestamp /*receiveTime*/)
+{
+    if (res < 0 && res != -ECANCELED && res != -ENOTCONN)
+    {
+        LOG_ERROR("TcpConnection::handleShutdownComplete [%s] err:%d \n", name_.c_str(), -res);
+    }
+}
+
+// zerocopy的完成通知通过MSG_ERRQUEUE返回, 同时会触发EPOLLERR
+bool TcpConnection::handleErrorQueue(bool *otherError)
+{
+    bool completed = false;
+    *otherError = false;
+    char control[128];
+    for (;;)
+    {
+        struct msghdr msg = {};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        if (::recvmsg(channel_.fd(), &msg, MSG_ERRQUEUE) < 0)
+        {
+            break;
+        }
+
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+            {
+                continue;
+            }
+            const struct sock_extended_err *serr = reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(cm));
+            if (serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY && serr->ee_errno == 0)
+            {
+                // ee_info~ee_data是完成的序号区间, COPIED表示内核退回了拷贝(比如loopback)
+                LOG_DEBUG("zerocopy completed [%u, %u] copied=%d \n",
+                    serr->ee_info, serr->ee_data, serr->ee_code == SO_EE_CODE_ZEROCOPY_COPIED);
+                outputBuffer_.zeroCopyCompleted(serr->ee_info, serr->ee_data);
+                completed = true;
+            }
+            else
+            {
+                *otherError = true;
+            }
+        }
+    }
+    return completed;
+}
+
 void TcpConnection::handleError()
 {
+    bool completed = false;
+    bool otherError = false;
+    if (outputBuffer_.zeroCopyThreshold() > 0)
+    {
+        completed = handleErrorQueue(&otherError);
+    }
+
+    // ECONNRESET等错误记录在SO_ERROR里, 不在错误队列中, 读完错误队列之后也要检查
     int optval;
     socklen_t optlen = sizeof optval;
     int err = 0;
-    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    if (::getsockopt(channel_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
     {
         err = errno;
     }
@@ -277,6 +1234,10 @@ void TcpConnection::handleError()
     {
         err = optval;
     }
+    if (err == 0 && completed && !otherError)
+    {
+        return;         // 只是zerocopy完成通知
+    }
 
     LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d \n", name_.c_str(), err);
 }
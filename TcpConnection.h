@@ -4,16 +4,24 @@
 #include <memory>
 #include <string>
 #include <atomic>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "noncopyable.h"
 #include "InetAddress.h"
 #include "Callbacks.h"
 #include "Buffer.h"
+#include "ChainBuffer.h"
 #include "Timestamp.h"
+#include "TimingWheel.h"
+#include "IoUringPoller.h"
+#include "Socket.h"
+#include "Channel.h"
 
-class Channel;
 class EventLoop;
-class Socket;
 
 /*
  * TcpServer => Acceptor => 有一个新用户连接, 通过accept函数拿到connfd
@@ -29,17 +37,69 @@ public:
                 const InetAddress& peerAddr);
     ~TcpConnection();
 
-    EventLoop* getLoop() const { return loop_; }
+    // 迁移之后返回新的loop
+    EventLoop* getLoop() const { return loop_.load(std::memory_order_acquire); }
     const std::string& name() const { return name_; }
     const InetAddress& localAddress() const { return localAddr_; }
     const InetAddress& peerAddress() const { return peerAddr_; }
 
     bool connected() const { return state_ == kConnected; }
 
-    // 发送数据
+    // 发送数据, 可以在任意线程调用, 其他线程调用时会拷贝一份
     void send(const std::string &buf);
+    // 转移所有权, 没有立即发完的部分直接引用, 不拷贝
+    void send(std::string &&buf);
+    // 换走buf的存储(buf变为空), 不拷贝
+    void send(Buffer *buf);
+    // 不可变的共享数据, 可以同时发送给多个连接
+    void send(const std::shared_ptr<const std::string> &message);
+    // 发送holder持有的[data, data+len], 发送完之前holder不会释放
+    // holder为空时没有立即发完的部分拷贝进输出缓冲区, 在其他线程调用时先拷贝
+    void send(const void *data, size_t len, const std::shared_ptr<const void> &holder);
+    // 发送Buffer切片, 引用切片的存储, 不拷贝
+    void send(const BufferSlice &slice);
+    // 分散的多段数据一次发送, 在其他线程调用时会合并拷贝
+    void sendv(const struct iovec *iov, int iovcnt);
+    // 用sendfile发送文件fd中从offset开始的len个字节, 和其他数据按调用顺序发送
+    // 内部会dup一份fd, 调用之后可以立即关闭fd; 排队的文件字节计入高水位和WriteCompleteCallback
+    void sendFile(int fd, off_t offset, size_t len);
+
+    /*
+     * MSG_ZEROCOPY发送, 只对转移了所有权的数据(send(std::string&&)/send(shared_ptr)等)生效,
+     * 不小于threshold的payload在内核通过MSG_ERRQUEUE确认之前不会释放
+     * 小数据用zerocopy反而更慢(页面pin和完成通知的开销), 阈值参考bench/zerocopy_bench
+    */
+    void setZeroCopy(bool on, size_t threshold = kDefaultZeroCopyThreshold);
+    static const size_t kDefaultZeroCopyThreshold = 64 * 1024;
     // 关闭连接
     void shutdown();
+    // 不等待数据发送完, 直接关闭连接, 用于对端违反协议等情况
+    void forceClose();
+
+    /*
+     * 把socket的可读/可写事件交给外部直接处理(SpliceRelay), 之后不再读写缓冲区, 也不再调用MessageCallback
+     * 只能在loop线程中、就绪模式下、输出缓冲区为空时调用, 否则返回false; 已设置的超时会被取消
+     * inputBuffer_中还没被用户取走的数据换到leftover中, 由接管方负责转发
+     * 连接的关闭仍由TcpConnection处理(包括forceClose和对端重置), 在用户的ConnectionCallback之前调用onClose
+    */
+    bool takeOverIo(const Channel::ReadEventCallback &onReadable,
+                    const Channel::EventCallback &onWritable,
+                    const Channel::EventCallback &onClose,
+                    Buffer *leftover);
+    // 接管之后设置关注的事件
+    void setIoInterest(bool reading, bool writing);
+    int fd() const { return socket_.fd(); }
+
+    /*
+     * 把连接迁移到另一个loop, 可以在任意线程调用, 用于把繁忙loop上的连接挪到空闲的loop
+     * 在原loop中从poller摘下channel、取消超时, 在新loop中重新注册并恢复超时, 两个缓冲区和回调原样保留
+     * 迁移期间其他线程的send/shutdown等调用暂存在连接中, 在新loop中按调用顺序执行, 不会乱序
+     * 只迁移就绪模式下已建立的连接, 完成模式和被takeOverIo接管的连接不迁移
+     * 迁移之后所有回调都在新loop线程中执行
+    */
+    void migrateTo(EventLoop *target);
+    // 累计读写的字节数, 可以在任意线程读取
+    uint64_t bytesTransferred() const { return bytesTransferred_.load(std::memory_order_relaxed); }
 
     void setConnectionCallback(const ConnectionCallback& cb) 
     { connectionCallback_ = cb;}
@@ -56,6 +116,26 @@ public:
     void setCloseCallback(const CloseCallback& cb)
     { closeCallback_ = cb; }
 
+    // 使用边沿触发模式, 读写都会一直进行到EAGAIN, 必须在connectEstablished之前调用
+    void setEdgeTriggered(bool on);
+
+    /*
+     * 完成模式, 必须在connectEstablished之前调用
+     * 所属loop使用io_uring时, 直接向io_uring提交multishot recv和send, 不再等待可读写事件后调用read/write
+     * 接收数据使用loop共享的缓冲区组, 到达后经过loop共享的读缓冲区交给用户, 回调接口和就绪模式完全一样
+     * 所属loop不支持时仍然使用就绪模式
+    */
+    void setCompletionMode(bool on) { completionRequested_ = on; }
+    bool completionMode() const { return completionMode_; }
+
+    // 连接超时, seconds <= 0表示关闭该超时, 超时后按对端关闭连接处理(handleClose)
+    // 空闲超时: 连续seconds秒没有任何读写
+    void setIdleTimeout(double seconds);
+    // 读超时: 连续seconds秒没有收到数据
+    void setReadTimeout(double seconds);
+    // 写超时: 有待发送数据时, 连续seconds秒没有任何发送进展
+    void setWriteTimeout(double seconds);
+
     // 连接建立
     void connectEstablished();
     // 连接销毁
@@ -66,35 +146,114 @@ private:
     void setState(StateE state) { state_ = state; }
 
     void handleRead(Timestamp receiveTime);
+    void deliverMessage(Buffer *buf, Timestamp receiveTime);
+    void adjustReadHint(ssize_t n, size_t writable);
     void handleWrite();
     void handleClose();
     void handleError();
 
 
-    void sendInLoop(const void* data, size_t len);
+    void sendInLoop(const void* data, size_t len, const std::shared_ptr<const void> &holder);
+    void sendvInLoop(const struct iovec *iov, int iovcnt, const std::shared_ptr<const void> &holder);
+    void sendFileInLoop(int fd, off_t offset, size_t len);
+    void setZeroCopyInLoop(bool on, size_t threshold);
+    // 读取MSG_ERRQUEUE中的zerocopy完成通知, 返回是否读到了完成通知, otherError返回是否读到了其他错误
+    bool handleErrorQueue(bool *otherError);
     void shutdownInLoop();
+    void forceCloseInLoop();
 
-    EventLoop *loop_;       // 这里绝对不是baseLoop, 因为TcpConnection都是在subLoop里边管理的
-    const std::string name_;
+    using Functor = std::function<void()>;
+    // 只在所属loop线程中访问loop_时使用
+    EventLoop* loop() const { return loop_.load(std::memory_order_relaxed); }
+    // 当前线程是连接所属的loop线程, 并且没有在迁移
+    bool isInOwnerLoop() const;
+    // 在所属loop中执行, 迁移期间暂存起来, 迁移完成后在新loop中执行
+    void runInOwnerLoop(Functor cb);
+    void queueInOwnerLoop(Functor cb);
+    void addBytesTransferred(ssize_t n)
+    { bytesTransferred_.store(bytesTransferred_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    void migrateInLoop(EventLoop *target);
+    void detachInLoop(EventLoop *target, bool drained);
+    void attachInLoop(bool reading, bool writing);
+
+    // 完成模式
+    void startRecv();
+    void submitSend();
+    void handleRecvComplete(int res, unsigned flags, Timestamp receiveTime);
+    void handleSendComplete(int res, unsigned flags, Timestamp receiveTime);
+    void handleShutdownComplete(int res, unsigned flags, Timestamp receiveTime);
+
+    static const int kMaxDrainPerEvent = 16;    // ET模式下一次事件最多读/写的次数
+    static const size_t kMinBlockSize = 4096;   // 小于这个大小的数据直接拷贝进outputBuffer_, 不单独占一个节点
+    static const size_t kMinReadHint = 4096;    // 每次读之前保证的最小可写空间
+
+    enum TimeoutE { kIdleTimeout, kReadTimeout, kWriteTimeout, kNumTimeouts, };
+    void setTimeoutInLoop(int which, double seconds);
+    // 刷新超时时间, 只修改时间轮entry的到期时间, 不分配内存
+    void refreshTimeout(int which);
+    void cancelTimeout(int which);
+    void cancelAllTimeouts();
+    void handleTimeout(int which);
+
+    // 完成模式才用到的状态, 在connectEstablished中确定使用完成模式后才分配, 就绪模式的连接不占这部分内存
+    struct CompletionState
+    {
+        IoUringOp recvOp;
+        IoUringOp sendOp;
+        IoUringOp shutdownOp;
+        std::vector<struct iovec> sendIov;                  // 在途sendmsg的参数
+        struct msghdr sendMsg;
+        bool shutdownLinked = false;                        // 是否有链接在send之后的shutdown在途
+        bool sendPolling = false;                           // 在途的sendOp是等待可写的POLL_ADD(发送文件)
+        bool zeroCopy = false;                              // 可以使用SENDMSG_ZC
+        int zeroCopySent = 0;                               // SENDMSG_ZC已经发送, 等待通知之后才能retrieve的字节数
+    };
+
+    /*
+     * 成员按访问频率排列: 前面是每次读写事件都会访问的热数据, 连续放在一起, 尽量少占几个cache line
+     * 后面是只在建立/关闭连接、设置选项时访问的冷数据
+     * Socket、Channel和两个缓冲区都直接作为成员, 和TcpConnection一起分配(见TcpServer::newConnection)
+    */
+    std::atomic<EventLoop*> loop_;  // 这里绝对不是baseLoop, 因为TcpConnection都是在subLoop里边管理的; 只在迁移时改变
     std::atomic_int state_;
     bool reading_;
+    bool completionMode_;
+    size_t readHint_;                                       // 根据最近的读取量调整的单次读取大小
+    size_t highWaterMark_;
+    std::atomic<uint64_t> bytesTransferred_;                // 只由所属loop线程写
 
     // 这里和Acceptor类似   Acceptor->mainLoop      TcpConnection->subLoop
-    std::unique_ptr<Socket> socket_;
-    std::unique_ptr<Channel> channel_;
+    Channel channel_;
 
-    const InetAddress localAddr_;
-    const InetAddress peerAddr_;
+    Buffer inputBuffer_;                                    // 保留不完整消息的接收缓冲区, 没有残留数据时不占内存
+    ChainBuffer outputBuffer_;                              // 发送数据的缓冲区, 分块存放, 不会移动已有的数据
 
     // 这些回调TcpServer也有, 用户通过写入TcpServer注册 TcpServer再将注册的回调传递给TcpConnection TcpConnection再将回调注册到Channel中
-    ConnectionCallback connectionCallback_;                 // 有新连接时的回调
     MessageCallback messageCallback_;                       // 有读写消息时的回调
     WriteCompleteCallback writeCompleteCallback_;           // 消息发送完以后的回调
+
+    double timeouts_[kNumTimeouts];                         // 各类超时时间, 单位秒
+    TimingWheel::Entry timeoutEntries_[kNumTimeouts];       // 挂在loop_时间轮上的超时节点
+
+    // 以下为冷数据
+    Socket socket_;
+    const std::string name_;
+    const InetAddress localAddr_;
+    const InetAddress peerAddr_;
+
+    ConnectionCallback connectionCallback_;                 // 有新连接时的回调
     HighWaterMarkCallback highWaterMarkCallback_;
     CloseCallback closeCallback_;
-    size_t highWaterMark_;
+    Channel::EventCallback ioCloseCallback_;                // takeOverIo的接管方, 连接关闭时通知
+
+    bool completionRequested_;
+    IoUringPoller *uring_;                                  // 完成模式下所属loop的poller
+    std::unique_ptr<CompletionState> uringState_;
 
-    Buffer inputBuffer_;                                    // 接收数据的缓冲区
-    Buffer outputBuffer_;                                   // 发送数据的缓冲区
+    // 迁移状态: migrating_为true时跨线程的调用暂存在migratePending_中
+    std::mutex migrateMutex_;
+    std::atomic_bool migrating_;
+    std::atomic_int enqueuing_;                             // 没加锁、正在投递到loop_的跨线程调用数
+    std::vector<Functor> migratePending_;
 };
 #endif
\ No newline at end of file
@@ -1,10 +1,16 @@
 #include "TcpServer.h"
 
 #include <functional>
+#include <algorithm>
+#include <vector>
+#include <future>
 #include <strings.h>
+#include <fcntl.h>
 
 #include "Logger.h"
 #include "TcpConnection.h"
+#include "Poller.h"
+#include "Slab.h"
 
 static EventLoop* CheckLoopNotNull(EventLoop *loop)
 {
@@ -20,22 +26,53 @@ TcpServer::TcpServer(EventLoop *loop,
                         const std::string &nameArg,
                         Option option)
             : loop_(CheckLoopNotNull(loop))
+            , listenAddr_(listenAddr)
             , ipPort_(listenAddr.toIpPort())
             , name_(nameArg)
             , acceptor_(new Acceptor(loop, listenAddr, option == kReusePort))
+            , acceptMode_(kMainLoopAccept)
             , threadPool_(new EventLoopThreadPool(loop, name_))
             , connectionCallback_()
             , messageCallback_()
-            , nextConnId_(1)
             , started_(0)
+            , nextConnId_(1)
+            , edgeTriggered_(false)
+            , completionMode_(false)
+            , rebalanceInterval_(0)
+            , rebalanceThreshold_(0)
 {
     // 当有新用户连接时, 会执行TcpServer::NewConnection回调
     acceptor_->setNewConnectionCallback(std::bind(&TcpServer::newConnection, this,
         std::placeholders::_1, std::placeholders::_2));
 }
 
+const int TcpServer::kMaxMigrationsPerRound;
+
 TcpServer::~TcpServer()
 {
+    if (rebalanceInterval_ > 0 && started_)
+    {
+        loop_->cancel(rebalanceTimer_);
+    }
+
+    // subloop的Acceptor在各自的loop线程中销毁, 等销毁完成之后才能继续, 之后不会再有新连接回调到这个TcpServer
+    // 同时取出这个loop接收的连接, 连接可能已经迁移, 在它当前所属的loop中销毁
+    std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+    for (size_t i = 0; i < loopAcceptors_.size(); ++i)
+    {
+        std::promise<void> done;
+        loops[i]->runInLoop([this, i, &done] {
+            loopAcceptors_[i].reset();
+            ConnectionMap connections;
+            connections.swap(*loopConnections_[i]);
+            for (auto &item : connections)
+            {
+                item.second->getLoop()->runInLoop(std::bind(&TcpConnection::connectDestroyed, item.second));
+            }
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
     for (auto& item : connections_)
     {
         // 这个局部的shared_ptr智能指针对象, 出右括号, 可以自动释放new出来的TcpConnection对象资源
@@ -50,6 +87,28 @@ TcpServer::~TcpServer()
 }
 
 // 设置底层subloop的个数
+void TcpServer::setCompletionMode(bool on)
+{
+    completionMode_ = on;
+    acceptor_->setMultishotAccept(on);
+    if (on)
+    {
+        threadPool_->setPollerType(Poller::kIoUringPoller);
+    }
+}
+
+void TcpServer::enableRebalance(double interval, int busyThreshold)
+{
+    if (busyThreshold <= 0)
+    {
+        LOG_ERROR("TcpServer::enableRebalance [%s] - busyThreshold must be positive, got %d \n",
+            name_.c_str(), busyThreshold);
+        return;
+    }
+    rebalanceInterval_ = interval;
+    rebalanceThreshold_ = busyThreshold;
+}
+
 void TcpServer::setThreadNum(int numThreads)
 {
     threadPool_->setThreadNum(numThreads);
@@ -61,18 +120,92 @@ void TcpServer::start()
     if (started_++ == 0)        // 防止一个TcpServer对象被start多次
     {
         threadPool_->start(threadInitCallback_);        // 启动底层的loop线程池
-        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+        if (acceptMode_ == kMainLoopAccept || loops[0] == loop_)
+        {
+            loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        }
+        else
+        {
+            if (acceptMode_ == kReusePortAccept)
+            {
+                // 每个subloop各自bind, 关闭mainLoop这个只bind还没有listen的socket
+                acceptor_.reset();
+            }
+            loopAcceptors_.resize(loops.size());
+            for (size_t i = 0; i < loops.size(); ++i)
+            {
+                loopConnections_.emplace_back(new ConnectionMap);
+            }
+            for (size_t i = 0; i < loops.size(); ++i)
+            {
+                loops[i]->runInLoop(std::bind(&TcpServer::startLoopAcceptor, this, loops[i], i));
+            }
+        }
+        if (rebalanceInterval_ > 0)
+        {
+            rebalanceTimer_ = loop_->runEvery(rebalanceInterval_, std::bind(&TcpServer::rebalance, this));
+        }
     }
 }
 
+// 在subloop线程中执行
+void TcpServer::startLoopAcceptor(EventLoop *ioLoop, size_t index)
+{
+    Acceptor *acceptor;
+    if (acceptMode_ == kReusePortAccept)
+    {
+        acceptor = new Acceptor(ioLoop, listenAddr_, true);
+    }
+    else
+    {
+        // 共享mainLoop那个Acceptor的socket, 每个loop一个dup出来的fd, 注册到各自的epoll中
+        int listenfd = ::fcntl(acceptor_->fd(), F_DUPFD_CLOEXEC, 0);
+        if (listenfd < 0)
+        {
+            LOG_FATAL("TcpServer::startLoopAcceptor [%s] dup listen fd err:%d \n", name_.c_str(), errno);
+        }
+        acceptor = new Acceptor(ioLoop, listenfd);
+        acceptor->setExclusive(true);
+    }
+    acceptor->setMultishotAccept(completionMode_);
+    acceptor->setNewConnectionCallback(std::bind(&TcpServer::newConnectionInLoop, this, ioLoop, index,
+        std::placeholders::_1, std::placeholders::_2));
+    acceptor->listen();
+    loopAcceptors_[index].reset(acceptor);
+}
+
 // 有一个新的客户端的连接, acceptor会执行这个回调操作, 负责将mainLoop接收到的请求连接(acceptChannel_会有读事件发生)通过回调轮询分发给subLoop处理
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
-    // 轮询算法, 选择一个subLoop, 来管理channel
-    EventLoop *ioLoop = threadPool_->getNextLoop();
+    // 按分配策略(默认轮询)选择一个subLoop, 来管理channel
+    EventLoop *ioLoop = threadPool_->getNextLoop(peerAddr);
+    TcpConnectionPtr conn = createConnection(ioLoop, sockfd, peerAddr);
+    // 设置了如何关闭连接的回调  conn->shutdown
+    conn->setCloseCallback(
+        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1)
+    );
+    connections_[conn->name()] = conn;
+
+    // 直接调用TcpConnection::connectEstablished
+    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+}
+
+void TcpServer::newConnectionInLoop(EventLoop *ioLoop, size_t index, int sockfd, const InetAddress &peerAddr)
+{
+    TcpConnectionPtr conn = createConnection(ioLoop, sockfd, peerAddr);
+    conn->setCloseCallback(
+        std::bind(&TcpServer::removeLoopConnection, this, ioLoop, index, std::placeholders::_1)
+    );
+    (*loopConnections_[index])[conn->name()] = conn;
+    conn->connectEstablished();
+}
+
+TcpConnectionPtr TcpServer::createConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr)
+{
     char buf[64] = { 0 };
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;              // 这里没有设置为原子类型是因为其只在mainLoop中执行, 不设计线程安全
+    // 各个subloop自己接收连接时会并发调用, 所以nextConnId_是原子的
+    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_++);
     std::string connName = name_ + buf;
 
     LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s \n",
@@ -90,26 +223,22 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
     InetAddress localAddr(local);
 
     // 根据连接成功的sockfd创建TcpConnection连接对象
-    TcpConnectionPtr conn(new TcpConnection(
+    // 连接对象(包括其中的Socket、Channel、缓冲区)和shared_ptr的控制块从subLoop的内存池中一次分配
+    TcpConnectionPtr conn = std::allocate_shared<TcpConnection>(
+                            SlabAllocator<TcpConnection>(ioLoop->slab()),
                             ioLoop,
                             connName,
                             sockfd,
                             localAddr,
-                            peerAddr));
+                            peerAddr);
     
-    connections_[connName] = conn;
     // 下面的回调都是用户设置给TcpServer=>TcpConnction=>Channel=>Poller=>notify
     conn->setConnectionCallback(connectionCallback_);
     conn->setMessageCallback(messageCallback_);
     conn->setWriteCompleteCallback(writeCompleteCallback_);
-
-    // 设置了如何关闭连接的回调  conn->shutdown
-    conn->setCloseCallback(
-        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1)
-    );
-
-    // 直接调用TcpConnection::connectEstablished
-    ioLoop->runInLoop(std::bind(&TcpConnection::connectEstablished, conn));
+    conn->setEdgeTriggered(edgeTriggered_);
+    conn->setCompletionMode(completionMode_);
+    return conn;
 }
 
 void TcpServer::removeConnection(const TcpConnectionPtr &conn)
@@ -129,4 +258,133 @@ void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
     ioLoop->queueInLoop(
         std::bind(&TcpConnection::connectDestroyed, conn)
     );
-}
\ No newline at end of file
+}
+
+void TcpServer::removeLoopConnection(EventLoop *ioLoop, size_t index, const TcpConnectionPtr &conn)
+{
+    LOG_INFO("TcpServer::removeLoopConnection [%s] - connection %s \n",
+        name_.c_str(), conn->name().c_str());
+
+    conn->getLoop()->queueInLoop(
+        std::bind(&TcpConnection::connectDestroyed, conn)
+    );
+    // 只有迁移过的连接才需要回到接收它的loop中删除
+    if (ioLoop->isInLoopThread())
+    {
+        loopConnections_[index]->erase(conn->name());
+    }
+    else
+    {
+        ioLoop->queueInLoop([this, index, conn] { loopConnections_[index]->erase(conn->name()); });
+    }
+}
+
+std::vector<TcpConnectionPtr> TcpServer::allConnections()
+{
+    std::vector<TcpConnectionPtr> conns;
+    conns.reserve(connections_.size());
+    for (const auto &item : connections_)
+    {
+        conns.push_back(item.second);
+    }
+    // 各subloop的连接表只能在各自的线程中读, 依次到每个loop中复制一份
+    std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+    for (size_t i = 0; i < loopConnections_.size(); ++i)
+    {
+        std::promise<void> done;
+        loops[i]->runInLoop([this, i, &conns, &done] {
+            for (const auto &item : *loopConnections_[i])
+            {
+                conns.push_back(item.second);
+            }
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+    return conns;
+}
+
+// 在mainLoop中定时执行, 只读取各loop和连接的原子计数, 迁移本身在连接所属的loop中完成
+// subloop自己接收连接时, 连接表要到各个loop中复制, mainLoop会等每个loop处理完这个任务
+void TcpServer::rebalance()
+{
+    std::vector<EventLoop*> loops = threadPool_->getAllLoops();
+    if (loops.size() < 2)
+    {
+        return;
+    }
+    EventLoop *hot = loops[0];
+    EventLoop *cool = loops[0];
+    int hotBusy = hot->recentBusyPermille();
+    int coolBusy = hotBusy;
+    for (size_t i = 1; i < loops.size(); ++i)
+    {
+        int busy = loops[i]->recentBusyPermille();
+        if (busy > hotBusy)
+        {
+            hot = loops[i];
+            hotBusy = busy;
+        }
+        if (busy < coolBusy)
+        {
+            cool = loops[i];
+            coolBusy = busy;
+        }
+    }
+
+    // 每次都更新流量采样, 下一轮用到的是这个周期内的流量
+    std::vector<std::pair<uint64_t, TcpConnectionPtr>> candidates;
+    uint64_t hotBytes = 0;
+    std::vector<TcpConnectionPtr> conns = allConnections();
+    std::unordered_map<std::string, uint64_t> samples;
+    samples.reserve(conns.size());
+    for (const TcpConnectionPtr &conn : conns)
+    {
+        uint64_t bytes = conn->bytesTransferred();
+        auto it = trafficSamples_.find(conn->name());
+        uint64_t delta = it == trafficSamples_.end() ? bytes : bytes - it->second;
+        samples[conn->name()] = bytes;
+        if (delta > 0 && conn->getLoop() == hot)
+        {
+            hotBytes += delta;
+            candidates.push_back(std::make_pair(delta, conn));
+        }
+    }
+    trafficSamples_.swap(samples);
+
+    if (hotBusy <= 0 || hotBusy < rebalanceThreshold_ || hotBusy - coolBusy < rebalanceThreshold_ / 2 || hotBytes == 0)
+    {
+        return;
+    }
+
+    /*
+     * 按流量从大到小迁移, 迁走的流量大约是两个loop繁忙程度差距的一半
+     * 一个连接的流量超过差距本身时跳过, 迁过去只会让对方变成最忙的loop
+    */
+    std::sort(candidates.begin(), candidates.end(),
+        [](const std::pair<uint64_t, TcpConnectionPtr> &a, const std::pair<uint64_t, TcpConnectionPtr> &b) {
+            return a.first > b.first;
+        });
+    const uint64_t share = hotBytes * (hotBusy - coolBusy) / (2 * hotBusy);
+    uint64_t moved = 0;
+    int migrations = 0;
+    for (const auto &candidate : candidates)
+    {
+        if (migrations >= kMaxMigrationsPerRound || moved >= share)
+        {
+            break;
+        }
+        if (candidate.first >= 2 * share)
+        {
+            continue;
+        }
+        candidate.second->migrateTo(cool);
+        moved += candidate.first;
+        ++migrations;
+    }
+    if (migrations > 0)
+    {
+        LOG_INFO("TcpServer::rebalance [%s] - busy %d/%d permille, %d connections (%llu bytes) migrated \n",
+            name_.c_str(), hotBusy, coolBusy, migrations, static_cast<unsigned long long>(moved));
+    }
+}
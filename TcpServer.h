@@ -11,6 +11,7 @@
 #include <memory>
 #include <atomic>
 #include <unordered_map>
+#include <vector>
 
 #include "EventLoop.h"
 #include "Accpetor.h"
@@ -33,6 +34,14 @@ public:
         kReusePort,         // 允许重用本地端口
     };
 
+    // 接收新连接的方式
+    enum AcceptMode
+    {
+        kMainLoopAccept,    // mainLoop接收连接, 按分配策略交给subloop(默认)
+        kReusePortAccept,   // 每个subloop一个SO_REUSEPORT的监听socket, 内核按四元组哈希把连接分给各个socket
+        kExclusiveAccept,   // subloop共享一个监听socket, 各自用EPOLLEXCLUSIVE注册, 新连接只唤醒一个loop
+    };
+
     TcpServer(EventLoop *loop,
                 const InetAddress &listenAddr,
                 const std::string &nameArg,
@@ -48,22 +57,72 @@ public:
     // 设置底层subloop的个数
     void setThreadNum(int numThreads);
 
+    /*
+     * 接收新连接的方式(AcceptMode), 在start之前设置, 没有subloop时总是由mainLoop接收
+     * 后两种方式由subloop自己accept, 连接就留在接收它的loop上, 建立连接不经过mainLoop, 此时分配策略不起作用
+     * 连接表也分到各个subloop, 由接收连接的loop添加和删除, 建立和关闭连接都不唤醒mainLoop
+     * kReusePortAccept不会在loop之间迁移已经到达的连接, 某个loop阻塞时分给它的连接只能排队;
+     * kExclusiveAccept由空闲等待中的loop接收, 负载更均匀, 但所有loop竞争同一个accept队列
+    */
+    void setAcceptMode(int mode) { acceptMode_ = mode; }
+
+    // 新连接使用边沿触发模式, 在start之前设置
+    void setEdgeTriggered(bool on) { edgeTriggered_ = on; }
+
+    // subloop使用的IO复用实现(Poller::PollerType), 在start之前设置
+    void setPollerType(int pollerType) { threadPool_->setPollerType(pollerType); }
+
+    // 新连接分配到subloop的策略(DispatchPolicy::PolicyType或者自定义的DispatchPolicy), 默认轮询, 在start之前设置
+    void setDispatchPolicy(int type) { threadPool_->setDispatchPolicy(type); }
+    void setDispatchPolicy(std::unique_ptr<DispatchPolicy> policy) { threadPool_->setDispatchPolicy(std::move(policy)); }
+
+    /*
+     * io_uring完成模式, 在start之前设置
+     * subloop改用io_uring, 连接直接提交recv/send(TcpConnection::setCompletionMode)
+     * mainLoop使用io_uring(EventLoop(Poller::kIoUringPoller)或MUDUO_USE_IOURING)时用multishot accept
+     * 内核不支持时自动退回就绪模式, 用户回调不需要任何改动
+    */
+    void setCompletionMode(bool on);
+
+    /*
+     * 运行期间在subloop之间迁移连接(TcpConnection::migrateTo), 平衡各loop的负载, 在start之前设置
+     * 每interval秒比较一次各subloop的recentBusyPermille, 最忙的loop超过busyThreshold千分比并且比最闲的loop
+     * 高出busyThreshold/2以上时, 把它上面这段时间流量最大的几个连接迁移到最闲的loop
+     * 只迁移就绪模式的连接, 迁移之后连接的回调在新loop线程中执行
+     * busyThreshold必须大于0, 否则忽略这次调用
+    */
+    void enableRebalance(double interval = 1.0, int busyThreshold = 500);
+
     // 开启服务器监听
     void start();
 
 private:
     void newConnection(int sockfd, const InetAddress &peerAddr);
+    // subloop自己接收的连接, 在ioLoop线程中执行
+    void newConnectionInLoop(EventLoop *ioLoop, size_t index, int sockfd, const InetAddress &peerAddr);
+    TcpConnectionPtr createConnection(EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr);
+    void startLoopAcceptor(EventLoop *ioLoop, size_t index);
     void removeConnection(const TcpConnectionPtr &conn);
     void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    // subloop自己接收的连接关闭时, 在连接当前所属的loop线程中执行
+    void removeLoopConnection(EventLoop *ioLoop, size_t index, const TcpConnectionPtr &conn);
+    // 所有连接的快照, 在mainLoop中调用
+    std::vector<TcpConnectionPtr> allConnections();
+    void rebalance();
+
+    static const int kMaxMigrationsPerRound = 4;
 
     using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
 
     EventLoop *loop_;       // baseloop 用户定义的loop
 
+    const InetAddress listenAddr_;
     const std::string ipPort_;
     const std::string name_;
 
     std::unique_ptr<Acceptor> acceptor_;                // 运行在mainLoop, 任务是监听新的连接事件
+    int acceptMode_;
+    std::vector<std::unique_ptr<Acceptor>> loopAcceptors_;     // 每个subloop的Acceptor, 在各自的loop线程中创建和销毁
 
     std::shared_ptr<EventLoopThreadPool> threadPool_;   // one loop per thread
     
@@ -74,7 +133,15 @@ private:
     ThreadInitCallback threadInitCallback_;             // loop线程初始化的回调
     std::atomic_int started_;
 
-    int nextConnId_;
-    ConnectionMap connections_;                         // 保存所有的连接
+    std::atomic_int nextConnId_;
+    bool edgeTriggered_;
+    bool completionMode_;
+    ConnectionMap connections_;                         // mainLoop接收的连接, 只在mainLoop中访问
+    std::vector<std::unique_ptr<ConnectionMap>> loopConnections_;  // 各subloop接收的连接, 只在接收它的loop中访问
+
+    double rebalanceInterval_;                          // <= 0表示不迁移连接
+    int rebalanceThreshold_;
+    TimerId rebalanceTimer_;
+    std::unordered_map<std::string, uint64_t> trafficSamples_;     // 上一次检查时各连接的bytesTransferred
 };
 #endif 
\ No newline at end of file
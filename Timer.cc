@@ -0,0 +1,3 @@
+#include "Timer.h"
+
+std::atomic<int64_t> Timer::s_numCreated_(0);
@@ -0,0 +1,66 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+#include <atomic>
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Callbacks.h"
+
+// 定时器, 保存到期时间、回调以及在TimerQueue最小堆中的位置
+class Timer : noncopyable
+{
+public:
+    Timer(TimerCallback cb, Timestamp when, double interval)
+        : callback_(std::move(cb))
+        , expiration_(when)
+        , interval_(interval)
+        , repeat_(interval > 0.0)
+        , sequence_(++s_numCreated_)
+        , heapIndex_(-1)
+        , canceled_(false)
+    {}
+
+    // Timer对象由TimerQueue回收复用, 复用时重新设置回调并分配新的序号
+    void reset(TimerCallback cb, Timestamp when, double interval)
+    {
+        callback_ = std::move(cb);
+        expiration_ = when;
+        interval_ = interval;
+        repeat_ = interval > 0.0;
+        sequence_ = ++s_numCreated_;
+        heapIndex_ = -1;
+        canceled_ = false;
+    }
+
+    void run() const { callback_(); }
+
+    Timestamp expiration() const { return expiration_; }
+    bool repeat() const { return repeat_; }
+    int64_t sequence() const { return sequence_; }
+
+    // 重复定时器, 从now开始计算下一次到期时间
+    void restart(Timestamp now) { expiration_ = addTime(now, interval_); }
+    // 回收时释放回调持有的资源
+    void release() { callback_ = TimerCallback(); }
+
+    int heapIndex() const { return heapIndex_; }
+    void setHeapIndex(int index) { heapIndex_ = index; }
+
+    bool canceled() const { return canceled_; }
+    void setCanceled() { canceled_ = true; }
+
+    static int64_t numCreated() { return s_numCreated_; }
+private:
+    TimerCallback callback_;
+    Timestamp expiration_;
+    double interval_;
+    bool repeat_;
+    int64_t sequence_;
+    int heapIndex_;         // 在最小堆中的下标, -1表示不在堆中
+    bool canceled_;
+
+    static std::atomic<int64_t> s_numCreated_;
+};
+
+#endif
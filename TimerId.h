@@ -0,0 +1,29 @@
+#ifndef _TIMERID_H_
+#define _TIMERID_H_
+
+#include <stdint.h>
+
+class Timer;
+
+// 用户可见的定时器标识, 用于取消定时器
+// Timer对象只会被TimerQueue回收复用而不会释放, 因此通过sequence就能判断timer是否仍是当初的那个定时器
+class TimerId
+{
+public:
+    TimerId()
+        : timer_(nullptr)
+        , sequence_(0)
+    {}
+
+    TimerId(Timer *timer, int64_t seq)
+        : timer_(timer)
+        , sequence_(seq)
+    {}
+
+    friend class TimerQueue;
+private:
+    Timer *timer_;
+    int64_t sequence_;
+};
+
+#endif
@@ -0,0 +1,295 @@
+#include "TimerQueue.h"
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "Logger.h"
+#include "EventLoop.h"
+#include "Timer.h"
+
+// 创建非阻塞的timerfd, 使用CLOCK_MONOTONIC不受系统时间调整的影响
+static int createTimerfd()
+{
+    int timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerfd < 0)
+    {
+        LOG_FATAL("timerfd_create error:%d \n", errno);
+    }
+    return timerfd;
+}
+
+// 计算距离when还有多长时间, 最少100微秒, 防止设置一个已过期的时间导致timerfd被停用
+static timespec howMuchTimeFromNow(Timestamp when)
+{
+    int64_t microseconds = when.microSecondsSinceEpoch()
+                            - Timestamp::now().microSecondsSinceEpoch();
+    if (microseconds < 100)
+    {
+        microseconds = 100;
+    }
+    timespec ts;
+    ts.tv_sec = static_cast<time_t>(microseconds / Timestamp::kMicroSecondsPerSecond);
+    ts.tv_nsec = static_cast<long>((microseconds % Timestamp::kMicroSecondsPerSecond) * 1000);
+    return ts;
+}
+
+static void readTimerfd(int timerfd)
+{
+    uint64_t howmany;
+    ssize_t n = ::read(timerfd, &howmany, sizeof howmany);
+    if (n != sizeof howmany)
+    {
+        LOG_ERROR("TimerQueue::handleRead() reads %ld bytes instead of 8 \n", n);
+    }
+}
+
+TimerQueue::TimerQueue(EventLoop *loop)
+    : loop_(loop)
+    , timerfd_(createTimerfd())
+    , timerfdChannel_(loop, timerfd_)
+    , callingExpiredTimers_(false)
+{
+    timerfdChannel_.setReadCallback(std::bind(&TimerQueue::handleRead, this));
+    // timerfd和wakeupfd一样, 一直监听读事件
+    timerfdChannel_.enableReading();
+}
+
+TimerQueue::~TimerQueue()
+{
+    timerfdChannel_.disableAll();
+    timerfdChannel_.remove();
+    ::close(timerfd_);
+
+    for (Timer *timer : heap_)
+    {
+        delete timer;
+    }
+    for (Timer *timer : freeTimers_)
+    {
+        delete timer;
+    }
+}
+
+TimerId TimerQueue::addTimer(TimerCallback cb, Timestamp when, double interval)
+{
+    Timer *timer = nullptr;
+    if (loop_->isInLoopThread())
+    {
+        // loop线程中优先复用回收的Timer对象, 避免大量短期定时器反复new/delete
+        if (!freeTimers_.empty())
+        {
+            timer = freeTimers_.back();
+            freeTimers_.pop_back();
+            timer->reset(std::move(cb), when, interval);
+        }
+        else
+        {
+            timer = new Timer(std::move(cb), when, interval);
+        }
+        addTimerInLoop(timer);
+    }
+    else
+    {
+        timer = new Timer(std::move(cb), when, interval);
+        // 交给loop之后timer可能已经触发并被回收复用, 不能再访问, 先生成TimerId
+        TimerId timerId(timer, timer->sequence());
+        loop_->queueInLoop(std::bind(&TimerQueue::addTimerInLoop, this, timer));
+        return timerId;
+    }
+    return TimerId(timer, timer->sequence());
+}
+
+void TimerQueue::cancel(TimerId timerId)
+{
+    loop_->runInLoop(std::bind(&TimerQueue::cancelInLoop, this, timerId));
+}
+
+void TimerQueue::addTimerInLoop(Timer *timer)
+{
+    // 跨线程添加的定时器, 在真正插入之前就被取消了
+    if (timer->canceled())
+    {
+        recycle(timer);
+        return;
+    }
+
+    heapPush(timer);
+    // 正在处理到期定时器时, 处理完毕后会统一重新设置timerfd
+    if (!callingExpiredTimers_ && timer->heapIndex() == 0)
+    {
+        resetTimerfd();
+    }
+}
+
+void TimerQueue::cancelInLoop(TimerId timerId)
+{
+    Timer *timer = timerId.timer_;
+    // Timer对象已经被复用, 说明原来的定时器已经执行完毕或者被取消
+    if (timer == nullptr || timer->sequence() != timerId.sequence_)
+    {
+        return;
+    }
+
+    if (timer->heapIndex() >= 0)
+    {
+        // 取消的如果是堆顶, 不重新设置timerfd, 多一次无效唤醒的代价比一次系统调用小
+        heapRemove(timer);
+        recycle(timer);
+    }
+    else
+    {
+        // 定时器正在执行(在自己的回调中取消自己), 或者跨线程添加还未插入堆中
+        timer->setCanceled();
+    }
+}
+
+void TimerQueue::handleRead()
+{
+    Timestamp now(Timestamp::now());
+    readTimerfd(timerfd_);
+    armedExpiration_ = Timestamp::invalid();
+
+    // 取出所有到期的定时器
+    while (!heap_.empty() && !(now < heap_[0]->expiration()))
+    {
+        Timer *timer = heap_[0];
+        heapRemove(timer);
+        expired_.push_back(timer);
+    }
+
+    callingExpiredTimers_ = true;
+    for (Timer *timer : expired_)
+    {
+        // 可能被同一批次中之前执行的回调取消了
+        if (!timer->canceled())
+        {
+            timer->run();
+        }
+    }
+    callingExpiredTimers_ = false;
+
+    // 重复定时器重新插入堆中, 其余的回收
+    for (Timer *timer : expired_)
+    {
+        if (timer->repeat() && !timer->canceled())
+        {
+            timer->restart(now);
+            heapPush(timer);
+        }
+        else
+        {
+            recycle(timer);
+        }
+    }
+    expired_.clear();
+
+    resetTimerfd();
+}
+
+void TimerQueue::recycle(Timer *timer)
+{
+    timer->release();
+    timer->setHeapIndex(-1);
+    freeTimers_.push_back(timer);
+}
+
+void TimerQueue::resetTimerfd()
+{
+    if (heap_.empty())
+    {
+        return;
+    }
+
+    Timestamp earliest = heap_[0]->expiration();
+    // timerfd已经设置了更早的到期时间, 到时候再重新设置即可
+    if (armedExpiration_.valid() && !(earliest < armedExpiration_))
+    {
+        return;
+    }
+
+    itimerspec newValue;
+    itimerspec oldValue;
+    memset(&newValue, 0, sizeof newValue);
+    memset(&oldValue, 0, sizeof oldValue);
+    newValue.it_value = howMuchTimeFromNow(earliest);
+    if (::timerfd_settime(timerfd_, 0, &newValue, &oldValue) < 0)
+    {
+        LOG_ERROR("timerfd_settime error:%d \n", errno);
+        return;
+    }
+    armedExpiration_ = earliest;
+}
+
+void TimerQueue::heapPush(Timer *timer)
+{
+    heap_.push_back(timer);
+    timer->setHeapIndex(static_cast<int>(heap_.size()) - 1);
+    siftUp(timer->heapIndex());
+}
+
+void TimerQueue::heapRemove(Timer *timer)
+{
+    int index = timer->heapIndex();
+    int last = static_cast<int>(heap_.size()) - 1;
+    timer->setHeapIndex(-1);
+    if (index != last)
+    {
+        heapSet(index, heap_[last]);
+        heap_.pop_back();
+        siftDown(index);
+        siftUp(index);
+    }
+    else
+    {
+        heap_.pop_back();
+    }
+}
+
+void TimerQueue::siftUp(int index)
+{
+    Timer *timer = heap_[index];
+    while (index > 0)
+    {
+        int parent = (index - 1) / 2;
+        if (!(timer->expiration() < heap_[parent]->expiration()))
+        {
+            break;
+        }
+        heapSet(index, heap_[parent]);
+        index = parent;
+    }
+    heapSet(index, timer);
+}
+
+void TimerQueue::siftDown(int index)
+{
+    int size = static_cast<int>(heap_.size());
+    Timer *timer = heap_[index];
+    while (true)
+    {
+        int child = index * 2 + 1;
+        if (child >= size)
+        {
+            break;
+        }
+        if (child + 1 < size && heap_[child + 1]->expiration() < heap_[child]->expiration())
+        {
+            ++child;
+        }
+        if (!(heap_[child]->expiration() < timer->expiration()))
+        {
+            break;
+        }
+        heapSet(index, heap_[child]);
+        index = child;
+    }
+    heapSet(index, timer);
+}
+
+void TimerQueue::heapSet(int index, Timer *timer)
+{
+    heap_[index] = timer;
+    timer->setHeapIndex(index);
+}
@@ -0,0 +1,62 @@
+#ifndef _TIMERQUEUE_H_
+#define _TIMERQUEUE_H_
+
+#include <vector>
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Callbacks.h"
+#include "Channel.h"
+#include "TimerId.h"
+
+class EventLoop;
+class Timer;
+
+/*
+ * 定时器队列, 每个EventLoop一个
+ * 1. 使用timerfd作为唤醒源, 以Channel的形式注册到Poller上, 定时器回调在loop线程中执行
+ * 2. 定时器保存在以到期时间为key的最小堆中, 插入/删除O(logn), Timer中记录自己在堆中的下标, 取消时无需查找
+ * 3. 只有最早到期时间发生变化时才调用timerfd_settime, 一次timerfd可读事件处理所有到期的定时器
+*/
+class TimerQueue : noncopyable
+{
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // 线程安全, 可以在其他线程调用
+    TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+    void cancel(TimerId timerId);
+
+    size_t size() const { return heap_.size(); }
+private:
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+    // timerfd可读时, 执行所有到期的定时器
+    void handleRead();
+
+    // 最小堆操作
+    void heapPush(Timer *timer);
+    void heapRemove(Timer *timer);
+    void siftUp(int index);
+    void siftDown(int index);
+    void heapSet(int index, Timer *timer);
+
+    // 回收Timer对象, 后续在loop线程中添加的定时器复用它
+    void recycle(Timer *timer);
+
+    // 根据堆顶重新设置timerfd的超时时间
+    void resetTimerfd();
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+
+    std::vector<Timer*> heap_;          // 以到期时间排序的最小堆
+    std::vector<Timer*> expired_;       // 本轮到期的定时器, 成员变量避免每次分配
+    std::vector<Timer*> freeTimers_;    // 回收的Timer对象
+    Timestamp armedExpiration_;         // timerfd当前设置的到期时间
+    bool callingExpiredTimers_;
+};
+
+#endif
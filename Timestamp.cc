@@ -1,5 +1,7 @@
 #include "Timestamp.h"
 
+#include <sys/time.h>
+
 Timestamp::Timestamp() : microSecondsSinceEpoch_(0) {}
 Timestamp::Timestamp(int64_t microSecondsSinceEpochArg)
     : microSecondsSinceEpoch_(microSecondsSinceEpochArg)
@@ -7,13 +9,16 @@ Timestamp::Timestamp(int64_t microSecondsSinceEpochArg)
 
 Timestamp Timestamp::now()
 {
-    return Timestamp(time(NULL));
+    timeval tv;
+    ::gettimeofday(&tv, NULL);
+    return Timestamp(static_cast<int64_t>(tv.tv_sec) * kMicroSecondsPerSecond + tv.tv_usec);
 }
 
 std::string Timestamp::toString() const
 {
     char buf[128] = {0};
-    tm *tm_time = localtime(&microSecondsSinceEpoch_);
+    time_t seconds = secondsSinceEpoch();
+    tm *tm_time = localtime(&seconds);
     snprintf(buf, 128, "%4d/%02d/%02d %02d:%02d:%02d",
         tm_time->tm_year + 1900,
         tm_time->tm_mon + 1,
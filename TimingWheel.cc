@@ -0,0 +1,270 @@
+#include "TimingWheel.h"
+
+#include <math.h>
+
+#include "EventLoop.h"
+#include "Logger.h"
+
+constexpr double TimingWheel::kDefaultTick;
+
+TimingWheel::Entry::Entry()
+    : wheel_(nullptr)
+    , expireTick_(0)
+{
+    prev = next = nullptr;
+}
+
+TimingWheel::Entry::~Entry()
+{
+    if (wheel_)
+    {
+        wheel_->cancel(this);
+    }
+}
+
+TimingWheel::TimingWheel(EventLoop *loop, double tickSeconds)
+    : loop_(loop)
+    , tick_(tickSeconds)
+    , start_(Timestamp::now())
+    , currentTick_(0)
+    , size_(0)
+    , ticking_(false)
+{
+    for (int level = 0; level < kLevels; ++level)
+    {
+        slots_[level].resize(level == 0 ? kLevel0Size : kLevelSize);
+        for (Link &head : slots_[level])
+        {
+            head.prev = head.next = &head;
+        }
+    }
+}
+
+TimingWheel::~TimingWheel()
+{
+    stopTicking();
+    // 剩余的entry只是解除关联, 不执行回调
+    for (int level = 0; level < kLevels; ++level)
+    {
+        for (Link &head : slots_[level])
+        {
+            while (head.next != &head)
+            {
+                Entry *entry = static_cast<Entry*>(head.next);
+                unlink(entry);
+                entry->wheel_ = nullptr;
+            }
+        }
+    }
+}
+
+void TimingWheel::schedule(Entry *entry, double delay)
+{
+    if (size_ == 0 && !ticking_)
+    {
+        // 时间轮是空的, 直接对齐到当前时间
+        currentTick_ = ticksFromStart(Timestamp::now());
+    }
+
+    int64_t ticks = static_cast<int64_t>(ceil(delay / tick_));
+    if (ticks < 1)
+    {
+        ticks = 1;
+    }
+    if (ticks >= kMaxTicks)
+    {
+        ticks = kMaxTicks - 1;
+    }
+    int64_t expireTick = currentTick_ + ticks;
+
+    if (entry->wheel_ == this)
+    {
+        // 到期时间推后: 只记录新的到期时间, 所在槽到期时会重新放置
+        if (expireTick >= entry->expireTick_)
+        {
+            entry->expireTick_ = expireTick;
+            return;
+        }
+        unlink(entry);
+    }
+    else
+    {
+        if (entry->wheel_)
+        {
+            entry->wheel_->cancel(entry);
+        }
+        entry->wheel_ = this;
+        ++size_;
+    }
+
+    entry->expireTick_ = expireTick;
+    place(entry);
+    startTicking();
+}
+
+void TimingWheel::cancel(Entry *entry)
+{
+    if (entry->wheel_ != this)
+    {
+        return;
+    }
+    unlink(entry);
+    entry->wheel_ = nullptr;
+    --size_;
+    if (size_ == 0)
+    {
+        stopTicking();
+    }
+}
+
+void TimingWheel::onTick()
+{
+    int64_t target = ticksFromStart(Timestamp::now());
+    while (currentTick_ < target && size_ > 0)
+    {
+        advance();
+    }
+    if (size_ == 0)
+    {
+        currentTick_ = target;
+        stopTicking();
+    }
+}
+
+void TimingWheel::advance()
+{
+    int64_t tick = ++currentTick_;
+
+    // 第0层转完一圈, 从高层依次级联下来
+    int64_t index = tick & (kLevel0Size - 1);
+    if (index == 0)
+    {
+        for (int level = 1; level < kLevels; ++level)
+        {
+            int shift = kLevel0Bits + (level - 1) * kLevelBits;
+            int64_t levelIndex = (tick >> shift) & (kLevelSize - 1);
+            cascade(level, levelIndex);
+            if (levelIndex != 0)
+            {
+                break;
+            }
+        }
+    }
+
+    // 先把到期槽整体摘下来, 回调中取消或重新调度其他entry都是安全的
+    Link expired;
+    spliceAll(&slots_[0][index], &expired);
+    while (expired.next != &expired)
+    {
+        Entry *entry = static_cast<Entry*>(expired.next);
+        unlink(entry);
+        if (entry->expireTick_ > tick)
+        {
+            // 被刷新过的entry, 重新放置
+            place(entry);
+            continue;
+        }
+
+        entry->wheel_ = nullptr;
+        --size_;
+        if (entry->callback_)
+        {
+            entry->callback_();
+        }
+    }
+}
+
+void TimingWheel::cascade(int level, int64_t index)
+{
+    Link pending;
+    spliceAll(&slots_[level][index], &pending);
+    while (pending.next != &pending)
+    {
+        Entry *entry = static_cast<Entry*>(pending.next);
+        unlink(entry);
+        place(entry);
+    }
+}
+
+void TimingWheel::place(Entry *entry)
+{
+    int64_t expire = entry->expireTick_;
+    int64_t delta = expire - currentTick_;
+    Link *head = nullptr;
+
+    if (delta < kLevel0Size)
+    {
+        // 已经过期的entry放到当前槽, 在本次advance中处理
+        if (delta < 0)
+        {
+            expire = currentTick_;
+        }
+        head = &slots_[0][expire & (kLevel0Size - 1)];
+    }
+    else
+    {
+        for (int level = 1; level < kLevels; ++level)
+        {
+            int shift = kLevel0Bits + (level - 1) * kLevelBits;
+            if (delta < (kLevel0Size << ((level - 1) * kLevelBits + kLevelBits)) || level == kLevels - 1)
+            {
+                head = &slots_[level][(expire >> shift) & (kLevelSize - 1)];
+                break;
+            }
+        }
+    }
+
+    linkBefore(head, entry);
+}
+
+int64_t TimingWheel::ticksFromStart(Timestamp now) const
+{
+    return static_cast<int64_t>(timeDifference(now, start_) / tick_);
+}
+
+void TimingWheel::startTicking()
+{
+    if (!ticking_)
+    {
+        ticking_ = true;
+        tickTimer_ = loop_->runEvery(tick_, std::bind(&TimingWheel::onTick, this));
+    }
+}
+
+void TimingWheel::stopTicking()
+{
+    if (ticking_)
+    {
+        ticking_ = false;
+        loop_->cancel(tickTimer_);
+    }
+}
+
+void TimingWheel::linkBefore(Link *pos, Link *node)
+{
+    node->prev = pos->prev;
+    node->next = pos;
+    pos->prev->next = node;
+    pos->prev = node;
+}
+
+void TimingWheel::unlink(Link *node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = nullptr;
+}
+
+void TimingWheel::spliceAll(Link *from, Link *to)
+{
+    if (from->next == from)
+    {
+        to->prev = to->next = to;
+        return;
+    }
+    to->next = from->next;
+    to->prev = from->prev;
+    to->next->prev = to;
+    to->prev->next = to;
+    from->prev = from->next = from;
+}
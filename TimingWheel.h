@@ -0,0 +1,96 @@
+#ifndef _TIMINGWHEEL_H_
+#define _TIMINGWHEEL_H_
+
+#include <vector>
+#include <stdint.h>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "TimerId.h"
+#include "Timestamp.h"
+
+class EventLoop;
+
+/*
+ * 分层时间轮, 每个EventLoop一个, 用于大量连接的空闲/读/写超时
+ * 第0层256个槽, 第1~3层各64个槽, tick为精度, 覆盖 2^26 个tick
+ * 
+ * Entry是侵入式的双向链表节点, 嵌入到使用者对象中, 插入、刷新、取消都是O(1)且不分配内存
+ * 刷新时如果到期时间只是推后, 仅修改expireTick_, 等所在槽到期时再重新放置, 连链表都不用动
+ * 时间轮的tick由TimerQueue的重复定时器驱动, 时间轮为空时停止tick, 空闲的loop不会被周期性唤醒
+*/
+class TimingWheel : noncopyable
+{
+private:
+    struct Link
+    {
+        Link *prev;
+        Link *next;
+    };
+public:
+    class Entry : private Link, noncopyable
+    {
+    public:
+        Entry();
+        ~Entry();
+
+        // 到期时的回调, 一般在使用者构造时设置一次
+        void setCallback(TimerCallback cb) { callback_ = std::move(cb); }
+        bool scheduled() const { return wheel_ != nullptr; }
+    private:
+        friend class TimingWheel;
+        TimingWheel *wheel_;            // 当前所在的时间轮, nullptr表示未调度
+        int64_t expireTick_;
+        TimerCallback callback_;
+    };
+
+    explicit TimingWheel(EventLoop *loop, double tickSeconds = kDefaultTick);
+    ~TimingWheel();
+
+    // 以下接口只能在loop线程中调用
+    // entry在delay秒之后到期, 如果已经在时间轮中则刷新到期时间
+    void schedule(Entry *entry, double delay);
+    void cancel(Entry *entry);
+
+    size_t size() const { return size_; }
+    double tickSeconds() const { return tick_; }
+
+    static constexpr double kDefaultTick = 0.1;
+private:
+    static const int kLevels = 4;
+    static const int kLevel0Bits = 8;
+    static const int kLevelBits = 6;
+    static const int64_t kLevel0Size = 1 << kLevel0Bits;
+    static const int64_t kLevelSize = 1 << kLevelBits;
+    static const int64_t kMaxTicks = int64_t(1) << (kLevel0Bits + (kLevels - 1) * kLevelBits);
+
+    // 定时器回调, 推进到当前时间对应的tick
+    void onTick();
+    // 推进一个tick, 处理级联和到期
+    void advance();
+    // 把level层的index槽中的entry重新放置到更低的层
+    void cascade(int level, int64_t index);
+    // 根据到期时间放入对应层的槽中
+    void place(Entry *entry);
+
+    int64_t ticksFromStart(Timestamp now) const;
+    void startTicking();
+    void stopTicking();
+
+    static void linkBefore(Link *pos, Link *node);
+    static void unlink(Link *node);
+    // 把槽中的链表整体转移到另一个表头上
+    static void spliceAll(Link *from, Link *to);
+
+    EventLoop *loop_;
+    const double tick_;
+    const Timestamp start_;
+    int64_t currentTick_;               // 已经处理过的tick
+    size_t size_;
+
+    std::vector<Link> slots_[kLevels];  // 每个槽都是一个带哨兵的双向循环链表
+    TimerId tickTimer_;
+    bool ticking_;
+};
+
+#endif
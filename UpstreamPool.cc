@@ -0,0 +1,385 @@
+#include "UpstreamPool.h"
+
+#include <algorithm>
+
+#include "Logger.h"
+#include "EventLoop.h"
+#include "TcpClient.h"
+#include "TcpConnection.h"
+#include "Buffer.h"
+
+static const double kCheckInterval = 0.5;                   // 健康检查的周期, 秒
+static const double kDefaultRequestTimeout = 5.0;
+static const double kDefaultIdleTimeout = 60.0;
+
+// 从池中移除的连接换上这两个回调, 之后的事件不再访问已经释放的Slot
+static void ignoreConnection(const TcpConnectionPtr&)
+{
+}
+
+static void discardMessage(const TcpConnectionPtr&, Buffer *buf, Timestamp)
+{
+    buf->retrieveAll();
+}
+
+const int UpstreamPool::kDefaultMinConnections;
+const int UpstreamPool::kDefaultMaxConnections;
+const int UpstreamPool::kDefaultMaxPipeline;
+const int UpstreamPool::kDefaultMaxFailures;
+
+UpstreamPool::UpstreamPool(EventLoop *loop, const ResponseFramer &framer)
+    : loop_(loop)
+    , framer_(framer)
+    , minConnections_(kDefaultMinConnections)
+    , maxConnections_(kDefaultMaxConnections)
+    , maxPipeline_(kDefaultMaxPipeline)
+    , requestTimeout_(kDefaultRequestTimeout)
+    , idleTimeout_(kDefaultIdleTimeout)
+    , maxFailures_(kDefaultMaxFailures)
+    , stats_()
+{
+    checkTimer_ = loop_->runEvery(kCheckInterval, std::bind(&UpstreamPool::checkHealth, this));
+}
+
+UpstreamPool::~UpstreamPool()
+{
+    loop_->cancel(checkTimer_);
+    for (auto &item : backends_)
+    {
+        for (const SlotPtr &slot : item.second->slots)
+        {
+            if (slot->conn)
+            {
+                slot->conn->setConnectionCallback(ignoreConnection);
+                slot->conn->setMessageCallback(discardMessage);
+                slot->conn->forceClose();
+                slot->conn.reset();
+            }
+        }
+    }
+}
+
+UpstreamPool::Stats UpstreamPool::stats() const
+{
+    Stats s = stats_;
+    s.connections = 0;
+    for (const auto &item : backends_)
+    {
+        s.connections += item.second->slots.size();
+    }
+    return s;
+}
+
+void UpstreamPool::addBackend(const InetAddress &addr)
+{
+    if (!loop_->isInLoopThread())
+    {
+        loop_->runInLoop(std::bind(&UpstreamPool::addBackend, this, addr));
+        return;
+    }
+    getBackend(addr);
+}
+
+UpstreamPool::Backend* UpstreamPool::getBackend(const InetAddress &addr)
+{
+    std::unique_ptr<Backend> &backend = backends_[addr.toIpPort()];
+    if (!backend)
+    {
+        backend.reset(new Backend);
+        backend->addr = addr;
+        backend->consecutiveFailures = 0;
+        for (int i = 0; i < minConnections_; ++i)
+        {
+            addSlot(backend.get(), true);
+        }
+    }
+    return backend.get();
+}
+
+void UpstreamPool::addSlot(Backend *backend, bool warm)
+{
+    SlotPtr slot = std::make_shared<Slot>();
+    slot->backend = backend;
+    slot->client.reset(new TcpClient(loop_, backend->addr, "upstream-" + backend->addr.toIpPort()));
+    slot->created = Timestamp::now();
+    slot->lastActive = slot->created;
+    slot->warm = warm;
+    slot->evicted = false;
+
+    // Slot由池持有, 从池中移除之前会先替换掉连接上的回调, 这里可以直接绑定裸指针
+    Slot *s = slot.get();
+    slot->client->setConnectionCallback(std::bind(&UpstreamPool::onConnection, this, s, std::placeholders::_1));
+    slot->client->setMessageCallback(std::bind(&UpstreamPool::onMessage, this, s,
+        std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    if (warm)
+    {
+        slot->client->enableRetry();
+    }
+    backend->slots.push_back(slot);
+    slot->client->connect();
+}
+
+void UpstreamPool::removeSlot(Slot *slot)
+{
+    std::vector<SlotPtr> &slots = slot->backend->slots;
+    auto it = std::find_if(slots.begin(), slots.end(),
+        [slot](const SlotPtr &p) { return p.get() == slot; });
+    if (it == slots.end())
+    {
+        return;
+    }
+    SlotPtr keep = *it;
+    slots.erase(it);
+
+    if (slot->conn)
+    {
+        slot->conn->setConnectionCallback(ignoreConnection);
+        slot->conn->setMessageCallback(discardMessage);
+        slot->conn->forceClose();
+        slot->conn.reset();
+    }
+    failAll(&slot->inflight);
+    // 可能正在这个Slot的TcpClient回调中, 延迟到回调返回之后再析构
+    loop_->queueInLoop([keep] {});
+}
+
+void UpstreamPool::request(const InetAddress &addr, std::string req, const ResponseCallback &cb)
+{
+    if (!loop_->isInLoopThread())
+    {
+        loop_->queueInLoop([this, addr, req, cb]() mutable {
+            request(addr, std::move(req), cb);
+        });
+        return;
+    }
+
+    ++stats_.requests;
+    Backend *backend = getBackend(addr);
+    if (backend->consecutiveFailures >= maxFailures_ && pickSlot(backend) == nullptr)
+    {
+        // 后端不健康并且没有可用的连接, 直接失败, 不在队列里堆积
+        ++stats_.failed;
+        cb(false, StringPiece());
+        return;
+    }
+
+    Pending pending;
+    pending.request = std::move(req);
+    pending.cb = cb;
+    pending.start = Timestamp::now();
+    backend->waiting.push_back(std::move(pending));
+    dispatch(backend);
+}
+
+// 选择在途请求最少并且还没到流水线上限的连接
+UpstreamPool::Slot* UpstreamPool::pickSlot(Backend *backend)
+{
+    Slot *best = nullptr;
+    for (const SlotPtr &slot : backend->slots)
+    {
+        if (!slot->conn || !slot->conn->connected() || slot->evicted)
+        {
+            continue;
+        }
+        if (static_cast<int>(slot->inflight.size()) >= maxPipeline_)
+        {
+            continue;
+        }
+        if (best == nullptr || slot->inflight.size() < best->inflight.size())
+        {
+            best = slot.get();
+        }
+    }
+    return best;
+}
+
+void UpstreamPool::dispatch(Backend *backend)
+{
+    bool busy = false;
+    while (!backend->waiting.empty())
+    {
+        Slot *slot = pickSlot(backend);
+        if (slot == nullptr)
+        {
+            busy = true;
+            break;
+        }
+        if (!slot->inflight.empty())
+        {
+            busy = true;        // 只能排在别的请求后面
+        }
+        Pending &pending = backend->waiting.front();
+        slot->conn->send(std::move(pending.request));
+        pending.request.clear();
+        slot->inflight.push_back(std::move(pending));
+        slot->lastActive = Timestamp::now();
+        backend->waiting.pop_front();
+    }
+
+    if (busy && static_cast<int>(backend->slots.size()) < maxConnections_)
+    {
+        // 同一时间只增加一个临时连接, 避免突发请求一次建立过多连接
+        bool connecting = false;
+        for (const SlotPtr &slot : backend->slots)
+        {
+            if (!slot->conn && !slot->evicted)
+            {
+                connecting = true;
+                break;
+            }
+        }
+        if (!connecting)
+        {
+            addSlot(backend, false);
+        }
+    }
+}
+
+void UpstreamPool::evict(Slot *slot, const char *reason)
+{
+    LOG_ERROR("UpstreamPool::evict connection to %s: %s, %zu requests in flight \n",
+        slot->backend->addr.toIpPort().c_str(), reason, slot->inflight.size());
+    ++stats_.evictions;
+    ++slot->backend->consecutiveFailures;
+    slot->evicted = true;
+    if (slot->conn)
+    {
+        // 常驻连接关闭后由TcpClient重连, 临时连接在关闭时从池中移除
+        slot->conn->forceClose();
+    }
+    failAll(&slot->inflight);
+}
+
+void UpstreamPool::failAll(std::deque<Pending> *pending)
+{
+    // 失败回调中可能发起新的请求, 先把队列换出来
+    std::deque<Pending> failed;
+    failed.swap(*pending);
+    for (Pending &p : failed)
+    {
+        ++stats_.failed;
+        p.cb(false, StringPiece());
+    }
+}
+
+void UpstreamPool::onConnection(Slot *slot, const TcpConnectionPtr &conn)
+{
+    Backend *backend = slot->backend;
+    if (conn->connected())
+    {
+        LOG_INFO("UpstreamPool::onConnection %s up \n", conn->name().c_str());
+        slot->conn = conn;
+        slot->evicted = false;
+        slot->lastActive = Timestamp::now();
+        backend->consecutiveFailures = 0;
+        dispatch(backend);
+    }
+    else
+    {
+        LOG_INFO("UpstreamPool::onConnection %s down \n", conn->name().c_str());
+        slot->conn.reset();
+        if (!slot->inflight.empty())
+        {
+            ++backend->consecutiveFailures;
+            failAll(&slot->inflight);
+        }
+        if (slot->warm)
+        {
+            slot->evicted = false;
+        }
+        else
+        {
+            removeSlot(slot);
+        }
+        dispatch(backend);
+    }
+}
+
+void UpstreamPool::onMessage(Slot *slot, const TcpConnectionPtr &, Buffer *buf, Timestamp receiveTime)
+{
+    if (slot->evicted)
+    {
+        buf->retrieveAll();
+        return;
+    }
+
+    while (!slot->inflight.empty())
+    {
+        ssize_t n = framer_(buf);
+        if (n == 0)
+        {
+            break;
+        }
+        if (n < 0 || static_cast<size_t>(n) > buf->readableBytes())
+        {
+            buf->retrieveAll();
+            evict(slot, "malformed response");
+            return;
+        }
+
+        // 先出队再回调, 回调中可以向同一个后端发起新的请求
+        Pending pending = std::move(slot->inflight.front());
+        slot->inflight.pop_front();
+        slot->lastActive = receiveTime;
+        slot->backend->consecutiveFailures = 0;
+        ++stats_.completed;
+        pending.cb(true, StringPiece(buf->peek(), n));
+        // 回调返回之后再丢弃响应, 保证回调期间StringPiece有效
+        buf->retrieve(n);
+    }
+
+    if (slot->inflight.empty() && buf->readableBytes() > 0 && !slot->evicted)
+    {
+        buf->retrieveAll();
+        evict(slot, "unexpected data without request");
+        return;
+    }
+    dispatch(slot->backend);
+}
+
+void UpstreamPool::checkHealth()
+{
+    Timestamp now = Timestamp::now();
+    for (auto &item : backends_)
+    {
+        Backend *backend = item.second.get();
+
+        // 排队太久的请求(后端一直连不上)按超时失败, 队列按请求时间有序
+        while (!backend->waiting.empty()
+            && timeDifference(now, backend->waiting.front().start) > requestTimeout_)
+        {
+            Pending pending = std::move(backend->waiting.front());
+            backend->waiting.pop_front();
+            ++backend->consecutiveFailures;
+            ++stats_.timeouts;
+            ++stats_.failed;
+            pending.cb(false, StringPiece());
+        }
+
+        // 回调中可能增删连接, 遍历一份拷贝
+        std::vector<SlotPtr> slots(backend->slots);
+        for (const SlotPtr &slot : slots)
+        {
+            if (slot->evicted)
+            {
+                continue;
+            }
+            if (!slot->inflight.empty()
+                && timeDifference(now, slot->inflight.front().start) > requestTimeout_)
+            {
+                stats_.timeouts += slot->inflight.size();
+                evict(slot.get(), "request timeout");
+            }
+            else if (!slot->warm && !slot->conn
+                && timeDifference(now, slot->created) > requestTimeout_)
+            {
+                removeSlot(slot.get());         // 临时连接一直没连上
+            }
+            else if (!slot->warm && slot->conn && slot->inflight.empty()
+                && timeDifference(now, slot->lastActive) > idleTimeout_)
+            {
+                removeSlot(slot.get());         // 临时连接空闲
+            }
+        }
+    }
+}
@@ -0,0 +1,137 @@
+#ifndef _UPSTREAMPOOL_H_
+#define _UPSTREAMPOOL_H_
+
+#include <functional>
+#include <string>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "InetAddress.h"
+#include "StringPiece.h"
+#include "Timestamp.h"
+#include "TimerId.h"
+
+class EventLoop;
+class TcpClient;
+
+/*
+ * 代理类服务访问后端用的连接池, 每个EventLoop一个, 按后端地址分组
+ * 池里的连接都在这个loop上, 请求从本loop发出时不需要跨线程; 在其他线程调用request会被转到loop线程执行
+ * 多个loop时在TcpServer的ThreadInitCallback里为每个subloop各建一个池(比如放在thread_local指针里)
+ *
+ * 协议无关: 用户提供ResponseFramer, 从输入缓冲区头部识别一个完整响应的长度
+ * 每个连接上可以有最多maxPipeline个在途请求, 响应按发送顺序(FIFO)对应到请求
+ * 每个后端保持至少minConnections个常驻连接, 断开后自动重连; 繁忙时临时增加到maxConnections个,
+ * 临时连接空闲超过idleTimeout后关闭
+ * 请求超时、协议错误、连接断开都会驱逐对应的连接, 在途请求以失败回调; 连续失败maxFailures次且
+ * 没有可用连接的后端, 新请求直接失败, 直到重新连上
+ * 所有回调都在loop线程中执行, 析构时还没完成的请求直接丢弃, 不再回调
+*/
+class UpstreamPool : noncopyable
+{
+public:
+    // ok为false表示请求失败, 此时response为空; response指向连接的输入缓冲区, 只在回调期间有效
+    using ResponseCallback = std::function<void(bool ok, const StringPiece &response)>;
+    // 返回缓冲区头部第一个完整响应的字节数, 0表示还不完整, 负数表示协议错误
+    using ResponseFramer = std::function<ssize_t(const Buffer*)>;
+
+    struct Stats
+    {
+        int64_t requests;
+        int64_t completed;
+        int64_t failed;             // 包括超时
+        int64_t timeouts;
+        int64_t evictions;          // 被驱逐的连接数
+        int64_t connections;        // 当前的连接(包括正在连接的)
+    };
+
+    UpstreamPool(EventLoop *loop, const ResponseFramer &framer);
+    // 必须在loop线程或者loop结束之后析构
+    ~UpstreamPool();
+
+    // 下面的选项在第一次addBackend/request之前设置
+    void setMinConnections(int n) { minConnections_ = n; }
+    void setMaxConnections(int n) { maxConnections_ = n; }
+    void setMaxPipeline(int n) { maxPipeline_ = n; }
+    void setRequestTimeout(double seconds) { requestTimeout_ = seconds; }
+    void setIdleTimeout(double seconds) { idleTimeout_ = seconds; }
+    void setMaxFailures(int n) { maxFailures_ = n; }
+
+    // 预先建立minConnections个常驻连接, 可以在任意线程调用; 不调用时第一次request会自动添加
+    void addBackend(const InetAddress &addr);
+
+    // req按值传入, 调用方用std::move转移所有权时发送不再拷贝
+    void request(const InetAddress &addr, std::string req, const ResponseCallback &cb);
+
+    EventLoop* getLoop() const { return loop_; }
+    // 只在loop线程中调用
+    Stats stats() const;
+
+    static const int kDefaultMinConnections = 1;
+    static const int kDefaultMaxConnections = 4;
+    static const int kDefaultMaxPipeline = 16;
+    static const int kDefaultMaxFailures = 3;
+
+private:
+    struct Backend;
+
+    struct Pending
+    {
+        std::string request;        // 发送之后为空
+        ResponseCallback cb;
+        Timestamp start;
+    };
+
+    struct Slot
+    {
+        Backend *backend;
+        std::unique_ptr<TcpClient> client;
+        TcpConnectionPtr conn;      // 连接建立之后才有
+        std::deque<Pending> inflight;
+        Timestamp created;
+        Timestamp lastActive;
+        bool warm;                  // 常驻连接, 断开后自动重连
+        bool evicted;               // 已驱逐, 等待连接关闭, 不再分配请求
+    };
+    using SlotPtr = std::shared_ptr<Slot>;
+
+    struct Backend
+    {
+        InetAddress addr;
+        std::vector<SlotPtr> slots;
+        std::deque<Pending> waiting;    // 还没有分配到连接的请求
+        int consecutiveFailures;
+    };
+
+    Backend* getBackend(const InetAddress &addr);
+    void addSlot(Backend *backend, bool warm);
+    void removeSlot(Slot *slot);
+    Slot* pickSlot(Backend *backend);
+    void dispatch(Backend *backend);
+    void evict(Slot *slot, const char *reason);
+    void failAll(std::deque<Pending> *pending);
+    void checkHealth();
+
+    void onConnection(Slot *slot, const TcpConnectionPtr &conn);
+    void onMessage(Slot *slot, const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    EventLoop *loop_;
+    ResponseFramer framer_;
+    int minConnections_;
+    int maxConnections_;
+    int maxPipeline_;
+    double requestTimeout_;
+    double idleTimeout_;
+    int maxFailures_;
+    TimerId checkTimer_;
+    std::unordered_map<std::string, std::unique_ptr<Backend>> backends_;   // ip:port => Backend
+    Stats stats_;
+};
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * 建立连接路径的基准测试
+ * 1. 接收速率: 若干客户端线程反复connect然后用RST关闭(避免TIME_WAIT耗尽端口), 统计服务端每秒建立的连接数,
+ *    以及各个io线程分到的连接数
+ * 2. 每个连接的内存: 保持若干个空闲连接, 用mallinfo2统计建立这些连接前后进程堆上使用的字节数之差
+ * 接收方式(TcpServer::AcceptMode): main mainLoop接收后分给io线程, reuseport 每个io线程一个SO_REUSEPORT监听socket,
+ * exclusive io线程共享监听socket并用EPOLLEXCLUSIVE注册
+ * 用法: ./accept_bench [端口] [io线程数] [客户端线程数] [秒数] [空闲连接数] [main|reuseport|exclusive]
+*/
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/TcpConnection.h>
+#include <mymuduo/Channel.h>
+#include <mymuduo/Logger.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static std::atomic<long> g_connected(0);
+static std::atomic<long> g_alive(0);
+
+static const int kMaxLoops = 64;
+static std::mutex g_loopsMutex;
+static std::vector<EventLoop*> g_loops;
+static std::atomic<long> g_perLoop[kMaxLoops];
+
+static int loopIndex(EventLoop *loop)
+{
+    std::lock_guard<std::mutex> lock(g_loopsMutex);
+    for (size_t i = 0; i < g_loops.size(); ++i)
+    {
+        if (g_loops[i] == loop)
+        {
+            return static_cast<int>(i);
+        }
+    }
+    return 0;
+}
+
+static double nowSeconds()
+{
+    struct timeval tv;
+    ::gettimeofday(&tv, nullptr);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int connectTo(uint16_t port)
+{
+    int sockfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    if (::connect(sockfd, (sockaddr*)&addr, sizeof addr) < 0)
+    {
+        ::close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+static void closeWithReset(int sockfd)
+{
+    struct linger lg = { 1, 0 };
+    ::setsockopt(sockfd, SOL_SOCKET, SO_LINGER, &lg, sizeof lg);
+    ::close(sockfd);
+}
+
+static void waitAlive(long target)
+{
+    while (g_alive.load() != target)
+    {
+        ::usleep(1000);
+    }
+}
+
+static void runClient(uint16_t port, int clients, double seconds, int idle, EventLoop *loop)
+{
+    // 接收速率
+    std::atomic_bool stop(false);
+    std::vector<std::thread> threads;
+    long before = g_connected.load();
+    for (int i = 0; i < kMaxLoops; ++i)
+    {
+        g_perLoop[i] = 0;
+    }
+    double start = nowSeconds();
+    for (int i = 0; i < clients; ++i)
+    {
+        threads.emplace_back([port, &stop] {
+            while (!stop.load())
+            {
+                int sockfd = connectTo(port);
+                if (sockfd >= 0)
+                {
+                    closeWithReset(sockfd);
+                }
+            }
+        });
+    }
+    ::usleep(static_cast<useconds_t>(seconds * 1e6));
+    stop = true;
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    double elapsed = nowSeconds() - start;
+    waitAlive(0);
+    printf("accept rate: %.0f conn/s (%ld connections in %.2fs, %d client threads)\n",
+        (g_connected.load() - before) / elapsed, g_connected.load() - before, elapsed, clients);
+    printf("connections per io thread:");
+    for (size_t i = 0; i < g_loops.size(); ++i)
+    {
+        printf(" %ld", g_perLoop[i].load());
+    }
+    printf("\n");
+
+    // 每个空闲连接占用的堆内存
+    ::malloc_trim(0);
+    size_t heapBefore = ::mallinfo2().uordblks;
+    std::vector<int> fds;
+    fds.reserve(idle);
+    for (int i = 0; i < idle; ++i)
+    {
+        int sockfd = connectTo(port);
+        if (sockfd < 0)
+        {
+            perror("connect");
+            break;
+        }
+        fds.push_back(sockfd);
+    }
+    waitAlive(static_cast<long>(fds.size()));
+    size_t heapAfter = ::mallinfo2().uordblks;
+    printf("idle connections: %zu, heap per connection: %.0f bytes\n",
+        fds.size(), fds.empty() ? 0.0 : static_cast<double>(heapAfter - heapBefore) / fds.size());
+    printf("sizeof(TcpConnection) = %zu, sizeof(Channel) = %zu\n", sizeof(TcpConnection), sizeof(Channel));
+
+    for (int sockfd : fds)
+    {
+        closeWithReset(sockfd);
+    }
+    waitAlive(0);
+    loop->runInLoop(std::bind(&EventLoop::quit, loop));
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = argc > 1 ? static_cast<uint16_t>(atoi(argv[1])) : 9989;
+    int ioThreads = argc > 2 ? atoi(argv[2]) : 2;
+    int clients = argc > 3 ? atoi(argv[3]) : 4;
+    double seconds = argc > 4 ? atof(argv[4]) : 5;
+    int idle = argc > 5 ? atoi(argv[5]) : 10000;
+    std::string mode = argc > 6 ? argv[6] : "main";
+    int acceptMode = TcpServer::kMainLoopAccept;
+    if (mode == "reuseport")
+    {
+        acceptMode = TcpServer::kReusePortAccept;
+    }
+    else if (mode == "exclusive")
+    {
+        acceptMode = TcpServer::kExclusiveAccept;
+    }
+    else if (mode != "main")
+    {
+        fprintf(stderr, "unknown accept mode: %s\n", mode.c_str());
+        return 1;
+    }
+    printf("accept mode: %s, %d io threads\n", mode.c_str(), ioThreads);
+
+    // 客户端用RST关闭, 服务端每个连接都会记一条ERROR日志
+    Logger::setLogLevel(FATAL);
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "AcceptBench");
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            ++g_perLoop[loopIndex(conn->getLoop())];
+            ++g_connected;
+            ++g_alive;
+        }
+        else
+        {
+            --g_alive;
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr&, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+    server.setThreadNum(ioThreads);
+    server.setAcceptMode(acceptMode);
+    server.setThreadIinitCallback([](EventLoop *loop) {
+        std::lock_guard<std::mutex> lock(g_loopsMutex);
+        g_loops.push_back(loop);
+    });
+    server.start();
+
+    std::thread client(runClient, port, clients, seconds, idle, &loop);
+    loop.loop();
+    client.join();
+    return 0;
+}
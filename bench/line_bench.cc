@@ -0,0 +1,115 @@
+/*
+ * Buffer分隔符查找的基准测试
+ * 构造一段很大的流水线请求(类似HTTP/1.1的请求头, 行长度随机), 分别用逐字节循环、std::search、
+ * Buffer::findCRLF/findEOL/findDelimiter把它切成行或者请求, 输出每种方法的吞吐, 并检查切出来的个数一致
+ * 用法: ./line_bench [数据MB数] [重复次数]
+*/
+#include <mymuduo/Buffer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <string>
+
+static double nowSeconds()
+{
+    struct timeval tv;
+    ::gettimeofday(&tv, nullptr);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static std::string makeRequests(size_t bytes)
+{
+    static const char kChars[] = "abcdefghijklmnopqrstuvwxyz0123456789-_=&";
+    std::string data;
+    data.reserve(bytes + 4096);
+    unsigned seed = 1;
+    while (data.size() < bytes)
+    {
+        data += "GET /";
+        int pathLen = 8 + rand_r(&seed) % 120;
+        for (int i = 0; i < pathLen; ++i)
+        {
+            data += kChars[rand_r(&seed) % (sizeof kChars - 1)];
+        }
+        data += " HTTP/1.1\r\nHost: example.com\r\n";
+        int headers = 2 + rand_r(&seed) % 8;
+        for (int h = 0; h < headers; ++h)
+        {
+            data += "X-Header-";
+            data += std::to_string(h);
+            data += ": ";
+            int valueLen = rand_r(&seed) % 200;
+            for (int i = 0; i < valueLen; ++i)
+            {
+                data += kChars[rand_r(&seed) % (sizeof kChars - 1)];
+            }
+            data += "\r\n";
+        }
+        data += "\r\n";
+    }
+    return data;
+}
+
+// 每个方法都在自己的Buffer上用retrieveUntil消费数据, 和协议解析的用法一致
+template <typename Find>
+static void run(const char *name, const std::string &data, int rounds, size_t delimLen, Find find)
+{
+    size_t count = 0;
+    double elapsed = 0;
+    for (int r = 0; r < rounds; ++r)
+    {
+        Buffer buf;
+        buf.append(data.data(), data.size());
+        count = 0;
+        double start = nowSeconds();
+        const char *pos;
+        while ((pos = find(buf)) != nullptr)
+        {
+            buf.retrieveUntil(pos + delimLen);
+            ++count;
+        }
+        elapsed += nowSeconds() - start;
+    }
+    printf("%-28s %10zu pieces %10.1f MB/s\n", name, count,
+        data.size() * rounds / elapsed / (1024 * 1024));
+}
+
+int main(int argc, char *argv[])
+{
+    size_t mb = argc > 1 ? atoi(argv[1]) : 64;
+    int rounds = argc > 2 ? atoi(argv[2]) : 5;
+    std::string data = makeRequests(mb * 1024 * 1024);
+    printf("%.1f MB of pipelined requests, %d rounds\n", data.size() / (1024.0 * 1024), rounds);
+
+    static const char kCRLF[] = "\r\n";
+    static const char kCRLFCRLF[] = "\r\n\r\n";
+
+    run("byte loop CRLF", data, rounds, 2, [](const Buffer &buf) -> const char* {
+        const char *end = buf.beginWrite();
+        for (const char *p = buf.peek(); p + 1 < end; ++p)
+        {
+            if (p[0] == '\r' && p[1] == '\n')
+            {
+                return p;
+            }
+        }
+        return nullptr;
+    });
+    run("std::search CRLF", data, rounds, 2, [](const Buffer &buf) -> const char* {
+        const char *pos = std::search(buf.peek(), buf.beginWrite(), kCRLF, kCRLF + 2);
+        return pos == buf.beginWrite() ? nullptr : pos;
+    });
+    run("Buffer::findCRLF", data, rounds, 2, [](const Buffer &buf) { return buf.findCRLF(); });
+    run("Buffer::findEOL", data, rounds, 1, [](const Buffer &buf) { return buf.findEOL(); });
+    run("std::search CRLFCRLF", data, rounds, 4, [](const Buffer &buf) -> const char* {
+        const char *pos = std::search(buf.peek(), buf.beginWrite(), kCRLFCRLF, kCRLFCRLF + 4);
+        return pos == buf.beginWrite() ? nullptr : pos;
+    });
+    run("Buffer::findDelimiter CRLFCRLF", data, rounds, 4, [](const Buffer &buf) {
+        return buf.findDelimiter(kCRLFCRLF, 4);
+    });
+    return 0;
+}
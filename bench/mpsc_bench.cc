@@ -0,0 +1,100 @@
+/*
+ * EventLoop任务队列的微基准测试
+ * 对比原来的 mutex + vector交换 实现和无锁MpscQueue, 生产者线程数 1 ~ 32, 单个消费者批量取出执行
+ * 用法: ./mpsc_bench [每种配置的任务总数]
+*/
+#include <mymuduo/MpscQueue.h>
+#include <mymuduo/Timestamp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using Functor = std::function<void()>;
+
+// 原EventLoop::queueInLoop/doPendingFunctors的实现
+class MutexQueue
+{
+public:
+    void push(Functor cb)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        pending_.emplace_back(std::move(cb));
+    }
+
+    template <typename Func>
+    size_t drain(Func func)
+    {
+        std::vector<Functor> functors;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            functors.swap(pending_);
+        }
+        for (Functor &functor : functors)
+        {
+            func(functor);
+        }
+        return functors.size();
+    }
+private:
+    std::mutex mutex_;
+    std::vector<Functor> pending_;
+};
+
+template <typename Queue>
+double run(int producers, int64_t total)
+{
+    Queue queue;
+    std::atomic_bool go(false);
+    int64_t executed = 0;
+    int64_t perProducer = total / producers;
+    int64_t expected = perProducer * producers;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers; ++i)
+    {
+        threads.emplace_back([&]() {
+            while (!go)
+            {
+                std::this_thread::yield();
+            }
+            for (int64_t n = 0; n < perProducer; ++n)
+            {
+                queue.push([&executed]() { ++executed; });
+            }
+        });
+    }
+
+    Timestamp start(Timestamp::now());
+    go = true;
+    while (executed < expected)
+    {
+        queue.drain([](Functor &functor) { functor(); });
+    }
+    Timestamp end(Timestamp::now());
+
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    return timeDifference(end, start);
+}
+
+int main(int argc, char *argv[])
+{
+    int64_t total = argc > 1 ? atoll(argv[1]) : 4 * 1000 * 1000;
+    printf("%-10s %16s %16s %8s\n", "producers", "mutex(Mops/s)", "mpsc(Mops/s)", "speedup");
+    for (int producers = 1; producers <= 32; producers *= 2)
+    {
+        int64_t n = total / producers * producers;
+        double mutexSec = run<MutexQueue>(producers, n);
+        double mpscSec = run<MpscQueue<Functor>>(producers, n);
+        printf("%-10d %16.2f %16.2f %7.2fx\n", producers,
+            n / mutexSec / 1e6, n / mpscSec / 1e6, mutexSec / mpscSec);
+    }
+    return 0;
+}
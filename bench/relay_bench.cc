@@ -0,0 +1,329 @@
+/*
+ * 四层转发的基准测试: 客户端 -> 中继(TcpServer + TcpClient) -> 接收端
+ * 中继有三种转发方式, 依次测试:
+ *   copy   每次消息retrieveAllAsString之后send, 经过inputBuffer_、string、outputBuffer_
+ *   buffer send(Buffer*), 换走输入缓冲区的存储, 少一次拷贝
+ *   splice SpliceRelay, 数据只在内核中经过管道搬运
+ * 接收端接受连接后先发一个字节, 经过中继到达客户端, 客户端收到后开始发送, 发完后半关闭并等待对端关闭
+ * 输出每种方式的吞吐, 以及中继所在loop线程每转发1GB消耗的CPU时间
+ * 用法: ./relay_bench [端口] [并发连接数] [每个连接的MB数]
+*/
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/TcpClient.h>
+#include <mymuduo/TcpConnection.h>
+#include <mymuduo/SpliceRelay.h>
+#include <mymuduo/EventLoop.h>
+#include <mymuduo/Logger.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <atomic>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum Mode { kCopy, kBuffer, kSplice };
+static const char *kModeNames[] = { "copy", "buffer", "splice" };
+
+static std::atomic<int> g_mode(kCopy);
+static std::atomic<int> g_sinkDone(0);
+static std::atomic<long> g_sinkBytes(0);
+static std::mutex g_timeMutex;
+static double g_start;
+static double g_end;
+
+static double nowSeconds()
+{
+    struct timeval tv;
+    ::gettimeofday(&tv, nullptr);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static double threadCpuSeconds()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static sockaddr_in loopbackAddr(uint16_t port)
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    return addr;
+}
+
+// 接收端: 每个连接一个线程, 先发一个字节, 然后读到EOF
+static void sinkMain(uint16_t port)
+{
+    int listenfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    ::setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+    sockaddr_in addr = loopbackAddr(port);
+    if (::bind(listenfd, (sockaddr*)&addr, sizeof addr) < 0 || ::listen(listenfd, 128) < 0)
+    {
+        perror("sink listen");
+        exit(1);
+    }
+    for (;;)
+    {
+        int connfd = ::accept(listenfd, nullptr, nullptr);
+        if (connfd < 0)
+        {
+            continue;
+        }
+        std::thread([connfd] {
+            ::write(connfd, "g", 1);
+            static thread_local char buf[256 * 1024];
+            long bytes = 0;
+            ssize_t n;
+            while ((n = ::read(connfd, buf, sizeof buf)) > 0)
+            {
+                bytes += n;
+            }
+            ::close(connfd);
+            g_sinkBytes += bytes;
+            {
+                std::lock_guard<std::mutex> lock(g_timeMutex);
+                g_end = std::max(g_end, nowSeconds());
+            }
+            ++g_sinkDone;
+        }).detach();
+    }
+}
+
+// 客户端: 等接收端的一个字节经过中继到达之后开始发送
+static void clientMain(uint16_t port, long bytes)
+{
+    int sockfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = loopbackAddr(port);
+    if (::connect(sockfd, (sockaddr*)&addr, sizeof addr) < 0)
+    {
+        perror("client connect");
+        exit(1);
+    }
+    char go;
+    if (::read(sockfd, &go, 1) != 1)
+    {
+        fprintf(stderr, "client: relay closed before start\n");
+        exit(1);
+    }
+    {
+        std::lock_guard<std::mutex> lock(g_timeMutex);
+        g_start = std::min(g_start, nowSeconds());
+    }
+
+    static char chunk[256 * 1024];
+    long remain = bytes;
+    while (remain > 0)
+    {
+        ssize_t n = ::write(sockfd, chunk, std::min<long>(remain, sizeof chunk));
+        if (n <= 0)
+        {
+            perror("client write");
+            exit(1);
+        }
+        remain -= n;
+    }
+    ::shutdown(sockfd, SHUT_WR);
+    while (::read(sockfd, chunk, sizeof chunk) > 0)
+    {
+    }
+    ::close(sockfd);
+}
+
+// 中继: 每个下游连接对应一个到接收端的TcpClient
+class Relay
+{
+public:
+    Relay(EventLoop *loop, uint16_t port, uint16_t sinkPort)
+        : loop_(loop)
+        , server_(loop, InetAddress(port), "relay")
+        , sinkAddr_(sinkPort)
+    {
+        server_.setConnectionCallback(std::bind(&Relay::onDownstream, this, std::placeholders::_1));
+        server_.setMessageCallback(std::bind(&Relay::onDownstreamMessage, this,
+            std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+    }
+
+    void start() { server_.start(); }
+
+private:
+    struct Session
+    {
+        std::unique_ptr<TcpClient> client;
+        TcpConnectionPtr upstream;
+    };
+
+    void onDownstream(const TcpConnectionPtr &down)
+    {
+        if (down->connected())
+        {
+            Session &session = sessions_[down->name()];
+            session.client.reset(new TcpClient(loop_, sinkAddr_, "upstream"));
+            std::weak_ptr<TcpConnection> weakDown(down);
+            std::string key = down->name();
+            int mode = g_mode;
+            session.client->setConnectionCallback([this, weakDown, key, mode](const TcpConnectionPtr &up) {
+                TcpConnectionPtr down = weakDown.lock();
+                if (up->connected())
+                {
+                    if (!down)
+                    {
+                        up->forceClose();
+                    }
+                    else if (mode == kSplice)
+                    {
+                        SpliceRelay::start(down, up);
+                    }
+                    else
+                    {
+                        sessions_[key].upstream = up;
+                    }
+                }
+                else
+                {
+                    if (down)
+                    {
+                        down->shutdown();
+                    }
+                    removeSession(key);
+                }
+            });
+            session.client->setMessageCallback([weakDown, mode](const TcpConnectionPtr&, Buffer *buf, Timestamp) {
+                TcpConnectionPtr down = weakDown.lock();
+                if (!down)
+                {
+                    buf->retrieveAll();
+                }
+                else if (mode == kCopy)
+                {
+                    down->send(buf->retrieveAllAsString());
+                }
+                else
+                {
+                    down->send(buf);
+                }
+            });
+            session.client->connect();
+        }
+        else
+        {
+            // 上游连接发完数据之后才关闭, 会话在上游断开时删除
+            auto it = sessions_.find(down->name());
+            if (it != sessions_.end() && it->second.upstream)
+            {
+                it->second.upstream->shutdown();
+            }
+        }
+    }
+
+    void removeSession(const std::string &key)
+    {
+        auto it = sessions_.find(key);
+        if (it != sessions_.end())
+        {
+            // 正在这个TcpClient的回调中, 放到下一轮loop再析构
+            std::shared_ptr<TcpClient> client(it->second.client.release());
+            loop_->queueInLoop([client] {});
+            sessions_.erase(it);
+        }
+    }
+
+    void onDownstreamMessage(const TcpConnectionPtr &down, Buffer *buf, Timestamp)
+    {
+        auto it = sessions_.find(down->name());
+        if (it == sessions_.end() || !it->second.upstream)
+        {
+            return;         // 上游还没连上时客户端不会发送数据
+        }
+        if (g_mode == kCopy)
+        {
+            it->second.upstream->send(buf->retrieveAllAsString());
+        }
+        else
+        {
+            it->second.upstream->send(buf);
+        }
+    }
+
+    EventLoop *loop_;
+    TcpServer server_;
+    InetAddress sinkAddr_;
+    std::map<std::string, Session> sessions_;     // 只在loop线程中访问
+};
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = argc > 1 ? atoi(argv[1]) : 9981;
+    int streams = argc > 2 ? atoi(argv[2]) : 4;
+    long mbPerStream = argc > 3 ? atol(argv[3]) : 1024;
+    const long bytesPerStream = mbPerStream * 1024 * 1024;
+
+    ::signal(SIGPIPE, SIG_IGN);
+    Logger::setLogLevel(FATAL);
+    std::thread(sinkMain, port + 1).detach();
+
+    EventLoop loop;
+    Relay relay(&loop, port, port + 1);
+    relay.start();
+
+    std::thread driver([&] {
+        ::usleep(200 * 1000);
+        printf("%d streams x %ld MB\n", streams, mbPerStream);
+        for (int mode = kCopy; mode <= kSplice; ++mode)
+        {
+            g_mode = mode;
+            g_start = 1e18;
+            g_end = 0;
+            g_sinkBytes = 0;
+            const int doneBefore = g_sinkDone;
+
+            auto cpuOfLoop = [&loop] {
+                std::promise<double> cpu;
+                loop.runInLoop([&cpu] { cpu.set_value(threadCpuSeconds()); });
+                return cpu.get_future().get();
+            };
+            double cpuStart = cpuOfLoop();
+
+            std::vector<std::thread> clients;
+            for (int i = 0; i < streams; ++i)
+            {
+                clients.emplace_back(clientMain, port, bytesPerStream);
+            }
+            for (std::thread &t : clients)
+            {
+                t.join();
+            }
+            while (g_sinkDone - doneBefore < streams)
+            {
+                ::usleep(1000);
+            }
+            double cpu = cpuOfLoop() - cpuStart;
+
+            double elapsed = g_end - g_start;
+            double gb = g_sinkBytes / (1024.0 * 1024 * 1024);
+            printf("%-8s %10.1f MB/s  relay cpu %6.3f s/GB%s\n", kModeNames[mode],
+                g_sinkBytes / elapsed / (1024 * 1024), cpu / gb,
+                g_sinkBytes == bytesPerStream * streams ? "" : "  (bytes lost!)");
+            ::usleep(200 * 1000);
+        }
+        loop.quit();
+    });
+
+    loop.loop();
+    driver.join();
+    return 0;
+}
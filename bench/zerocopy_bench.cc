@@ -0,0 +1,127 @@
+/*
+ * MSG_ZEROCOPY发送的基准测试
+ * 服务端用TcpConnection::send(shared_ptr)反复发送同一块payload, 分别关闭/开启zerocopy, 客户端线程在本机接收并计时
+ * 输出不同payload大小下的吞吐和整个进程消耗的CPU时间, 用来确定setZeroCopy的阈值
+ * 注意: loopback上内核会退回拷贝(SO_EE_CODE_ZEROCOPY_COPIED), 交叉点要在真实网卡上测
+ * 用法: ./zerocopy_bench [端口] [每种配置发送的总MB数]
+*/
+#include <mymuduo/TcpServer.h>
+#include <mymuduo/Logger.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <string>
+#include <thread>
+
+static double cpuSeconds()
+{
+    struct rusage ru;
+    ::getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static double nowSeconds()
+{
+    struct timeval tv;
+    ::gettimeofday(&tv, nullptr);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// 请求: "<payload大小> <次数> <是否zerocopy>\n", 服务端把payload发送指定次数
+static void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp)
+{
+    const char *eol = static_cast<const char*>(memchr(buf->peek(), '\n', buf->readableBytes()));
+    if (eol == nullptr)
+    {
+        return;
+    }
+    std::string line = buf->retrieveAsString(eol - buf->peek() + 1);
+    size_t size = 0;
+    int count = 0;
+    int zeroCopy = 0;
+    sscanf(line.c_str(), "%zu %d %d", &size, &count, &zeroCopy);
+
+    conn->setZeroCopy(zeroCopy != 0, size);
+    std::shared_ptr<const std::string> payload = std::make_shared<const std::string>(size, 'z');
+    for (int i = 0; i < count; ++i)
+    {
+        conn->send(payload);
+    }
+}
+
+static void runClient(uint16_t port, size_t totalBytes, EventLoop *loop)
+{
+    static const size_t sizes[] = { 4096, 16384, 65536, 262144, 1048576, 4194304, 16777216 };
+    std::string buf(1 << 20, 0);
+
+    printf("%10s %14s %14s %14s %14s\n", "size", "copy MB/s", "zc MB/s", "copy cpu s", "zc cpu s");
+    for (size_t size : sizes)
+    {
+        double mbps[2];
+        double cpu[2];
+        for (int zc = 0; zc < 2; ++zc)
+        {
+            int sockfd = ::socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr;
+            memset(&addr, 0, sizeof addr);
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+            if (::connect(sockfd, (sockaddr*)&addr, sizeof addr) < 0)
+            {
+                perror("connect");
+                exit(1);
+            }
+
+            int count = static_cast<int>(totalBytes / size);
+            char req[64];
+            int n = snprintf(req, sizeof req, "%zu %d %d\n", size, count, zc);
+            double start = nowSeconds();
+            double cpuStart = cpuSeconds();
+            ::write(sockfd, req, n);
+
+            size_t expected = size * count;
+            size_t received = 0;
+            while (received < expected)
+            {
+                ssize_t r = ::read(sockfd, &*buf.begin(), buf.size());
+                if (r <= 0)
+                {
+                    break;
+                }
+                received += r;
+            }
+            double elapsed = nowSeconds() - start;
+            mbps[zc] = received / elapsed / (1024 * 1024);
+            cpu[zc] = cpuSeconds() - cpuStart;
+            ::close(sockfd);
+        }
+        printf("%10zu %14.1f %14.1f %14.3f %14.3f\n", size, mbps[0], mbps[1], cpu[0], cpu[1]);
+    }
+
+    loop->runInLoop(std::bind(&EventLoop::quit, loop));
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t port = argc > 1 ? static_cast<uint16_t>(atoi(argv[1])) : 9988;
+    size_t totalMB = argc > 2 ? atoi(argv[2]) : 512;
+
+    Logger::setLogLevel(ERROR);
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "ZeroCopyBench");
+    server.setConnectionCallback([](const TcpConnectionPtr&) {});
+    server.setMessageCallback(onMessage);
+    server.start();
+
+    std::thread client(runClient, port, totalMB * 1024 * 1024, &loop);
+    loop.loop();
+    client.join();
+    return 0;
+}
@@ -49,8 +49,10 @@ private:
                 Buffer *buf,
                 Timestamp time)
     {
-        std::string msg = buf->retrieveAllAsString();
-        conn->send(msg);
+        // buf可能是loop共享的读缓冲区, 直接发送它的视图, 只有没立即发完的部分才拷贝
+        StringPiece msg = buf->toStringPiece();
+        conn->send(msg.data(), msg.size(), nullptr);
+        buf->retrieveAll();
         conn->shutdown();       // 关闭的是 写端  EPOLLHUB => closeCallback_
     }
 